@@ -0,0 +1,71 @@
+// -----------------------------------------------------------------------------
+// Monotonic arena
+// -----------------------------------------------------------------------------
+#ifndef gpw_arena_h
+#define gpw_arena_h
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace gpw::str {
+
+// Memory resource for the short lived strings of a unit of work (e.g. a
+// request): allocations are carved out of an inline buffer, then out of
+// geometrically growing chunks of the upstream resource, and deallocation is a
+// no-op.  release() frees everything at once, after which the arena starts
+// again from its inline buffer.  Pass it to the std::pmr overloads of gpw::str:
+//
+//   arena a;
+//   auto name = to_lower (trim (field, default_whitespace), &a);
+//   ...
+//   a.release();
+//
+// Like std::pmr::monotonic_buffer_resource, an arena is not thread safe: use
+// one per thread.  The strings allocated from it must not outlive it or be
+// used after release().
+class arena final : public std::pmr::memory_resource {
+  public:
+    static constexpr std::size_t inline_size = 2048;
+
+    explicit arena (std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : _resource{_buffer, sizeof _buffer, upstream} {}
+
+    arena (const arena&)            = delete;
+    arena& operator= (const arena&) = delete;
+
+    // Frees all the memory allocated from the arena.
+    void
+    release () {
+        _resource.release();
+        _allocated = 0;
+    }
+
+    // Number of bytes allocated since the construction or the last release
+    std::size_t
+    allocated () const {
+        return _allocated;
+    }
+
+  private:
+    void*
+    do_allocate (std::size_t bytes, std::size_t alignment) override {
+        _allocated += bytes;
+        return _resource.allocate (bytes, alignment);
+    }
+
+    void
+    do_deallocate (void*, std::size_t, std::size_t) override {}
+
+    bool
+    do_is_equal (const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    alignas (std::max_align_t) std::byte _buffer[inline_size];
+    std::pmr::monotonic_buffer_resource _resource;
+    std::size_t                         _allocated = 0;
+};
+
+}  // namespace gpw::str
+
+#endif
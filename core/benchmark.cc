@@ -0,0 +1,138 @@
+#include "core/benchmark.h"
+#include "core/number.h"
+#include "core/str.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace gpw::util::dt {
+
+namespace {
+
+// Percentile p (0 to 1) of sorted values
+double
+percentile (const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    const double      pos   = p * static_cast<double> (sorted.size() - 1);
+    const std::size_t below = static_cast<std::size_t> (pos);
+    if (below + 1 >= sorted.size()) return sorted.back();
+    const double fraction = pos - static_cast<double> (below);
+    return sorted[below] + fraction * (sorted[below + 1] - sorted[below]);
+}
+
+const char* const fields[] = {"min_ns", "mean_ns", "median_ns", "p90_ns",
+                              "p99_ns", "max_ns",  "mad_ns"};
+
+template <typename F>
+void
+for_each_statistic (const benchmark_result& result, F&& on_statistic) {
+    const double values[] = {result.min, result.mean, result.median, result.p90,
+                             result.p99, result.max,  result.mad};
+    for (std::size_t i = 0; i < std::size (values); ++i)
+        on_statistic (fields[i], values[i]);
+}
+
+void
+append_number (std::string& out, double value) {
+    if (!std::isfinite (value)) value = 0;
+    out += gpw::str::format_double (value);
+}
+
+void
+append_csv_field (std::string& out, const std::string& str) {
+    if (str.find_first_of (",\"\r\n") == std::string::npos) {
+        out += str;
+        return;
+    }
+    out += '"';
+    for (const char c : str) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+}  // namespace
+
+benchmark_result
+summarize (std::string name, std::size_t iterations, std::vector<double> samples) {
+    benchmark_result result;
+    result.name       = std::move (name);
+    result.iterations = iterations;
+    result.samples    = std::move (samples);
+    if (result.samples.empty()) return result;
+
+    std::vector<double> sorted = result.samples;
+    std::sort (sorted.begin(), sorted.end());
+    result.min    = sorted.front();
+    result.max    = sorted.back();
+    result.mean   = std::accumulate (sorted.begin(), sorted.end(), 0.0) / sorted.size();
+    result.median = percentile (sorted, 0.5);
+    result.p90    = percentile (sorted, 0.9);
+    result.p99    = percentile (sorted, 0.99);
+
+    for (auto& value : sorted)
+        value = std::abs (value - result.median);
+    std::sort (sorted.begin(), sorted.end());
+    result.mad = percentile (sorted, 0.5);
+    return result;
+}
+
+std::size_t
+benchmark_runner::_next_iterations (std::size_t iterations, std::int64_t elapsed) const {
+    // Aim a bit past the target from the rate measured so far, growing at
+    // most tenfold since short runs are timed imprecisely.
+    const double target   = _options.sample_msec * 1e6;
+    double       estimate = static_cast<double> (iterations) * 10;
+    if (elapsed > 0) {
+        estimate = std::min (estimate, static_cast<double> (iterations) * target * 1.2 / elapsed);
+    }
+    const auto next = std::max (iterations + 1, static_cast<std::size_t> (estimate));
+    return std::min (next, _options.max_iterations);
+}
+
+std::string
+benchmark_runner::to_json () const {
+    std::string out = "{\"benchmarks\": [";
+    for (std::size_t i = 0; i < _results.size(); ++i) {
+        const auto& result = _results[i];
+        out += (i == 0) ? "\n  {\"name\": " : ",\n  {\"name\": ";
+        gpw::str::append_json_string (out, result.name);
+        out += ", \"iterations\": " + std::to_string (result.iterations);
+        out += ", \"samples\": " + std::to_string (result.samples.size());
+        for_each_statistic (result, [&out] (const char* field, double value) {
+            out += ", \"";
+            out += field;
+            out += "\": ";
+            append_number (out, value);
+        });
+        out += '}';
+    }
+    out += _results.empty() ? "]}\n" : "\n]}\n";
+    return out;
+}
+
+std::string
+benchmark_runner::to_csv () const {
+    std::string out = "name,iterations,samples";
+    for (const char* field : fields) {
+        out += ',';
+        out += field;
+    }
+    out += '\n';
+
+    for (const auto& result : _results) {
+        append_csv_field (out, result.name);
+        out += ',' + std::to_string (result.iterations);
+        out += ',' + std::to_string (result.samples.size());
+        for_each_statistic (result, [&out] (const char*, double value) {
+            out += ',';
+            append_number (out, value);
+        });
+        out += '\n';
+    }
+    return out;
+}
+
+}  // namespace gpw::util::dt
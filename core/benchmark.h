@@ -0,0 +1,167 @@
+// -----------------------------------------------------------------------------
+// Micro-benchmarks
+// -----------------------------------------------------------------------------
+#ifndef gpw_benchmark_h
+#define gpw_benchmark_h
+
+#include "core/date_time.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace gpw::util::dt {
+
+// Keeps the compiler from optimizing away the computation of value, as if
+// value were read (and, for a modifiable value, written) by unknown code.
+template <typename T>
+inline void
+do_not_optimize (const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile ("" : : "r,m"(value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+#endif
+}
+
+template <typename T>
+inline void
+do_not_optimize (T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    if constexpr (std::is_trivially_copyable_v<T> && sizeof (T) <= sizeof (void*))
+        asm volatile ("" : "+r"(value) : : "memory");
+    else
+        asm volatile ("" : "+m"(value) : : "memory");
+#else
+    static void* volatile sink;
+    sink = &value;
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+#endif
+}
+
+// Forces the pending writes to memory to be done, e.g. to time the writes of
+// a function whose results are not read.
+inline void
+clobber_memory () {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile ("" : : : "memory");
+#else
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+#endif
+}
+
+struct benchmark_options {
+    double      warmup_msec    = 100;  // Minimum duration of the warm up
+    double      sample_msec    = 10;   // Minimum duration of a sample
+    std::size_t count_samples  = 30;
+    std::size_t max_iterations = 1000000000;  // Per sample
+};
+
+// Statistics of the samples of a benchmark, in nanoseconds per iteration.
+// The percentiles interpolate linearly between the closest samples, and mad
+// is the median absolute deviation from the median, a measure of the spread
+// which unlike the standard deviation is not inflated by a few outliers (e.g.
+// interrupts).
+struct benchmark_result {
+    std::string         name;
+    std::size_t         iterations = 0;  // Per sample
+    std::vector<double> samples;
+
+    double min    = 0;
+    double mean   = 0;
+    double median = 0;
+    double p90    = 0;
+    double p99    = 0;
+    double max    = 0;
+    double mad    = 0;
+};
+
+benchmark_result
+summarize (std::string name, std::size_t iterations, std::vector<double> samples);
+
+// Runs benchmarks and collects their results
+//
+// A benchmark is a function called repeatedly.  It is first run for the warm
+// up time (caches, branch predictors, processor frequency), while the number
+// of iterations of a sample is raised until a sample lasts the sample time;
+// then the samples are timed on the monotonic clock.
+//
+//   dt::benchmark_runner bench;
+//   bench.run ("to_lower", [&] { dt::do_not_optimize (gpw::str::to_lower (line)); });
+//   bench.run ("to_lower_in_place", [&] {
+//       gpw::str::to_lower_in_place (line);
+//       dt::clobber_memory();
+//   });
+//   std::ofstream{"bench.json"} << bench.to_json();
+class benchmark_runner {
+  public:
+    explicit benchmark_runner (benchmark_options options = {}) : _options{options} {}
+
+    // Returns the result, which stays valid until the next run.
+    template <typename F>
+    const benchmark_result&
+    run (std::string name, F&& body);
+
+    const std::vector<benchmark_result>&
+    results () const {
+        return _results;
+    }
+
+    // {"benchmarks": [{"name": ..., "iterations": ..., "samples": ...,
+    // "min_ns": ..., "mean_ns": ..., "median_ns": ..., "p90_ns": ...,
+    // "p99_ns": ..., "max_ns": ..., "mad_ns": ...}, ...]}
+    std::string
+    to_json () const;
+
+    // A header line with the same fields, then one line per benchmark
+    std::string
+    to_csv () const;
+
+  private:
+    // Iterations to try next, after iterations took elapsed nanoseconds
+    std::size_t
+    _next_iterations (std::size_t iterations, std::int64_t elapsed) const;
+
+    benchmark_options             _options;
+    std::vector<benchmark_result> _results;
+};
+
+template <typename F>
+const benchmark_result&
+benchmark_runner::run (std::string name, F&& body) {
+    auto time_iterations = [&body] (std::size_t iterations) {
+        const std::int64_t start = now_nsec();
+        for (std::size_t i = 0; i < iterations; ++i)
+            body();
+        return now_nsec() - start;
+    };
+
+    const auto target     = static_cast<std::int64_t> (_options.sample_msec * 1e6);
+    const auto warmup_end = now_nsec() + static_cast<std::int64_t> (_options.warmup_msec * 1e6);
+
+    std::size_t iterations = 1;
+    for (;;) {
+        const std::int64_t elapsed = time_iterations (iterations);
+        const bool         enough  = elapsed >= target || iterations >= _options.max_iterations;
+        if (enough && now_nsec() >= warmup_end) break;
+        if (!enough) iterations = _next_iterations (iterations, elapsed);
+    }
+
+    std::vector<double> samples (_options.count_samples);
+    for (auto& sample : samples) {
+        sample = static_cast<double> (time_iterations (iterations))
+               / static_cast<double> (iterations);
+    }
+    _results.push_back (summarize (std::move (name), iterations, std::move (samples)));
+    return _results.back();
+}
+
+}  // namespace gpw::util::dt
+
+#endif
@@ -8,7 +8,10 @@
 #ifndef gpw_concurrency_hpp
 #define gpw_concurrency_hpp
 
+#include "core/profile_hooks.h"
+
 #include <condition_variable>
+#include <exception>
 #include <functional>
 #include <mutex>
 #include <queue>
@@ -129,6 +132,7 @@ private:
   // The infinite loop function.  This waits for the task queue to open up.
   void
   thread_loop () {
+    gpw::profile::set_thread_name ("thread_pool worker");
     while (true) {
       std::function<void()> job;
       {
@@ -143,7 +147,7 @@ private:
         _jobs.pop();
       }
       // Execute the job and decrease the number of jobs when finished.
-      job();
+      gpw::profile::run_in_zone ("thread_pool job", job);
       {
         std::unique_lock<std::mutex> lock (_count_jobs_mutex);
         _count_jobs--;
@@ -169,6 +173,106 @@ private:
   std::queue<std::function<void()>> _jobs;
 };
 
+// Counts down the completion of a group of jobs, so that the thread which
+// queued them can wait for all of them (like std::latch of C++20).
+//
+//   latch done (count);
+//   for (int i = 0; i < count; ++i)
+//     tp.queue_job ([&done] { /* ... */ done.count_down(); });
+//   done.wait();
+class latch {
+public:
+  explicit latch (std::ptrdiff_t count) : _count{count} {}
+
+  void
+  count_down () {
+    std::unique_lock<std::mutex> lock (_mutex);
+    if (--_count == 0) _zero.notify_all();
+  }
+
+  // Blocks until the count reaches zero.
+  void
+  wait () {
+    std::unique_lock<std::mutex> lock (_mutex);
+    _zero.wait (lock, [this] { return _count <= 0; });
+  }
+
+private:
+  std::ptrdiff_t          _count;
+  std::mutex              _mutex;
+  std::condition_variable _zero;
+};
+
+// Keeps the first exception thrown by a group of jobs, so that the thread
+// which waits for them can rethrow it, an exception escaping a job being fatal
+// to the worker.
+//
+//   first_exception error;
+//   latch           done (count);
+//   for (int i = 0; i < count; ++i)
+//     tp.queue_job ([&] {
+//       try { /* ... */ } catch (...) { error.capture(); }
+//       done.count_down();
+//     });
+//   done.wait();
+//   error.rethrow();
+class first_exception {
+public:
+  // Stores the current exception, unless one is stored already.  To be called
+  // from a catch block.
+  void
+  capture () noexcept {
+    std::unique_lock<std::mutex> lock (_mutex);
+    if (!_error) _error = std::current_exception();
+  }
+
+  // Rethrows the stored exception, if any.
+  void
+  rethrow () {
+    std::unique_lock<std::mutex> lock (_mutex);
+    if (_error) std::rethrow_exception (_error);
+  }
+
+private:
+  std::mutex         _mutex;
+  std::exception_ptr _error;
+};
+
+// Limits the number of jobs using a resource at a time (like
+// std::counting_semaphore of C++20).  Acquiring all the permits waits for the
+// jobs holding them.
+//
+//   semaphore slots (max_in_flight);
+//   for (const auto& item : items) {
+//     slots.acquire();
+//     tp.queue_job ([&slots, item] { /* ... */ slots.release(); });
+//   }
+//   for (int i = 0; i < max_in_flight; ++i) slots.acquire();
+class semaphore {
+public:
+  explicit semaphore (std::ptrdiff_t count) : _count{count} {}
+
+  // Blocks until a permit is available, and takes it.
+  void
+  acquire () {
+    std::unique_lock<std::mutex> lock (_mutex);
+    _available.wait (lock, [this] { return _count > 0; });
+    --_count;
+  }
+
+  void
+  release () {
+    std::unique_lock<std::mutex> lock (_mutex);
+    ++_count;
+    _available.notify_one();
+  }
+
+private:
+  std::ptrdiff_t          _count;
+  std::mutex              _mutex;
+  std::condition_variable _available;
+};
+
 }  // namespace gpw::concurrency
 
 #endif
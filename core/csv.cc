@@ -0,0 +1,309 @@
+#include "core/csv.h"
+#include "core/simd.h"
+
+#include <algorithm>
+
+namespace gpw::str {
+
+namespace {
+
+// Bit masks of the quotes, delimiters and newlines in the block
+// [block, block + 64), for the bytes of the block inside [0, n)
+struct block_masks {
+    std::uint64_t quote;
+    std::uint64_t delim;
+    std::uint64_t newline;
+};
+
+using masks_fn =
+    block_masks (*) (const char* s, std::size_t n, std::size_t block, csv_dialect dialect);
+
+block_masks
+masks_scalar (const char* s, std::size_t n, std::size_t block, csv_dialect dialect) {
+    block_masks       m{0, 0, 0};
+    const std::size_t end = std::min (n, block + 64);
+    for (std::size_t i = block; i < end; ++i) {
+        const std::uint64_t bit = std::uint64_t{1} << (i - block);
+        if (s[i] == dialect.quote) m.quote |= bit;
+        if (s[i] == dialect.delimiter) m.delim |= bit;
+        if (s[i] == '\n') m.newline |= bit;
+    }
+    return m;
+}
+
+#if defined(GPW_SIMD_X86)
+block_masks
+masks_sse2 (const char* s, std::size_t n, std::size_t block, csv_dialect dialect) {
+    if (block + 64 > n) return masks_scalar (s, n, block, dialect);
+
+    const __m128i quote   = _mm_set1_epi8 (dialect.quote);
+    const __m128i delim   = _mm_set1_epi8 (dialect.delimiter);
+    const __m128i newline = _mm_set1_epi8 ('\n');
+    block_masks   m{0, 0, 0};
+    for (int k = 0; k < 4; ++k) {
+        const __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + block + 16 * k));
+        const auto    q  = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, quote));
+        const auto    d  = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, delim));
+        const auto    nl = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, newline));
+        m.quote |= std::uint64_t{static_cast<std::uint32_t> (q)} << (16 * k);
+        m.delim |= std::uint64_t{static_cast<std::uint32_t> (d)} << (16 * k);
+        m.newline |= std::uint64_t{static_cast<std::uint32_t> (nl)} << (16 * k);
+    }
+    return m;
+}
+
+GPW_TARGET_AVX2 inline std::uint64_t
+eq_mask_avx2 (__m256i lo, __m256i hi, __m256i needle) {
+    const auto m_lo =
+        static_cast<std::uint32_t> (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (lo, needle)));
+    const auto m_hi =
+        static_cast<std::uint32_t> (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (hi, needle)));
+    return (std::uint64_t{m_hi} << 32) | m_lo;
+}
+
+GPW_TARGET_AVX2 block_masks
+masks_avx2 (const char* s, std::size_t n, std::size_t block, csv_dialect dialect) {
+    if (block + 64 > n) return masks_scalar (s, n, block, dialect);
+
+    const __m256i lo = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + block));
+    const __m256i hi = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + block + 32));
+    return {
+        eq_mask_avx2 (lo, hi, _mm256_set1_epi8 (dialect.quote)),
+        eq_mask_avx2 (lo, hi, _mm256_set1_epi8 (dialect.delimiter)),
+        eq_mask_avx2 (lo, hi, _mm256_set1_epi8 ('\n'))
+    };
+}
+#endif
+
+block_masks
+masks (const char* s, std::size_t n, std::size_t block, csv_dialect dialect) {
+#if defined(GPW_SIMD_X86)
+    static const masks_fn kernel = gpw::simd::has_avx2() ? masks_avx2 : masks_sse2;
+#else
+    static const masks_fn kernel = masks_scalar;
+#endif
+    return kernel (s, n, block, dialect);
+}
+
+// Bit i of the result is the XOR of the bits [0, i] of x
+std::uint64_t
+prefix_xor (std::uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Mask of the bytes inside quotes given the quote mask of a block.  inside is
+// the state at the end of the previous block (all ones inside quotes) and is
+// updated to the state at the end of this one.  An opening quote counts as
+// inside and a closing one as outside, which does not matter since neither is
+// a delimiter or a newline.
+std::uint64_t
+quoted (std::uint64_t quote, std::uint64_t& inside) {
+    const std::uint64_t mask = prefix_xor (quote) ^ inside;
+    inside                   = (mask >> 63) ? ~std::uint64_t{0} : 0;
+    return mask;
+}
+
+// Offset of the first byte after the first newline outside quotes in data,
+// starting with the given quote state, or the length of data if none.
+std::size_t
+first_record_end (std::string_view data, bool inside_quotes, csv_dialect dialect) {
+    const std::size_t n      = data.length();
+    std::uint64_t     inside = inside_quotes ? ~std::uint64_t{0} : 0;
+    for (std::size_t block = 0; block < n; block += 64) {
+        const block_masks   m        = masks (data.data(), n, block, dialect);
+        const std::uint64_t newlines = m.newline & ~quoted (m.quote, inside);
+        if (newlines != 0) return block + gpw::simd::count_trailing_zeros (newlines) + 1;
+    }
+    return n;
+}
+
+// Parity of the number of quotes in data
+bool
+quote_parity (std::string_view data, csv_dialect dialect) {
+    const std::size_t n      = data.length();
+    std::uint64_t     inside = 0;
+    for (std::size_t block = 0; block < n; block += 64)
+        quoted (masks (data.data(), n, block, dialect).quote, inside);
+    return inside != 0;
+}
+
+}  // namespace
+
+std::size_t
+csv_parser::_next_structural () {
+    const std::size_t n = _data.length();
+    while (_structural == 0) {
+        if (_next_block >= n) return std::string_view::npos;
+        _block = _next_block;
+        _next_block += 64;
+
+        const block_masks m = masks (_data.data(), n, _block, _dialect);
+        _structural         = (m.delim | m.newline) & ~quoted (m.quote, _inside);
+    }
+
+    const std::size_t pos = _block + gpw::simd::count_trailing_zeros (_structural);
+    _structural &= _structural - 1;
+    return pos;
+}
+
+void
+csv_parser::_add_field (
+    std::vector<std::string_view>& fields, std::size_t begin, std::size_t end, bool eol
+) {
+    std::string_view field = _data.substr (begin, end - begin);
+    if (eol && !field.empty() && field.back() == '\r') field.remove_suffix (1);
+
+    const char quote = _dialect.quote;
+    if (field.length() >= 2 && field.front() == quote && field.back() == quote) {
+        field = field.substr (1, field.length() - 2);
+        if (field.find (quote) != std::string_view::npos) {
+            const std::size_t offset = _unescaped.length();
+            for (std::size_t i = 0; i < field.length(); ++i) {
+                _unescaped += field[i];
+                if (field[i] == quote) ++i;
+            }
+            _pending.emplace_back (fields.size(), offset, _unescaped.length() - offset);
+        }
+    }
+    fields.push_back (field);
+}
+
+bool
+csv_parser::next (std::vector<std::string_view>& fields) {
+    const std::size_t n = _data.length();
+    if (_pos >= n) return false;
+
+    fields.clear();
+    _unescaped.clear();
+    _pending.clear();
+
+    std::size_t begin = _pos;
+    for (;;) {
+        const std::size_t pos = _next_structural();
+        if (pos == std::string_view::npos) {
+            _add_field (fields, begin, n, true);
+            _pos = n;
+            break;
+        }
+
+        const bool eol = _data[pos] == '\n';
+        _add_field (fields, begin, pos, eol);
+        begin = pos + 1;
+        if (eol) {
+            _pos = begin;
+            break;
+        }
+    }
+
+    for (const auto& [idx, offset, length] : _pending)
+        fields[idx] = std::string_view{_unescaped.data() + offset, length};
+    return true;
+}
+
+std::vector<std::string_view>
+split_records (
+    std::string_view                data,
+    std::size_t                     count,
+    gpw::concurrency::thread_pool& pool,
+    csv_dialect                     dialect
+) {
+    const std::size_t n = data.length();
+    count               = std::min (count, n / 64 + 1);
+    if (count <= 1) return {data};
+
+    // Raw splits [bounds[i], bounds[i + 1]) of about the same size
+    std::vector<std::size_t> bounds (count + 1);
+    for (std::size_t i = 0; i <= count; ++i)
+        bounds[i] = i * (n / count) + std::min (i, n % count);
+
+    // Quote parity of each split, then the quote state at its beginning
+    std::vector<char> parity (count);
+    {
+        gpw::concurrency::first_exception error;
+        gpw::concurrency::latch           done (count);
+        for (std::size_t i = 0; i < count; ++i) {
+            pool.queue_job ([&, i] {
+                try {
+                    parity[i] = quote_parity (
+                        data.substr (bounds[i], bounds[i + 1] - bounds[i]), dialect
+                    );
+                } catch (...) {
+                    error.capture();
+                }
+                done.count_down();
+            });
+        }
+        done.wait();
+        error.rethrow();
+    }
+
+    std::vector<char> inside (count, 0);
+    for (std::size_t i = 1; i < count; ++i)
+        inside[i] = inside[i - 1] ^ parity[i - 1];
+
+    // Each split but the first begins after the first record end it contains
+    std::vector<std::size_t> starts (count + 1, n);
+    starts[0] = 0;
+    {
+        gpw::concurrency::first_exception error;
+        gpw::concurrency::latch           done (count - 1);
+        for (std::size_t i = 1; i < count; ++i) {
+            pool.queue_job ([&, i] {
+                try {
+                    const auto rest = data.substr (bounds[i]);
+                    starts[i] = bounds[i] + first_record_end (rest, inside[i] != 0, dialect);
+                } catch (...) {
+                    error.capture();
+                }
+                done.count_down();
+            });
+        }
+        done.wait();
+        error.rethrow();
+    }
+
+    std::vector<std::string_view> chunks;
+    std::size_t                   begin = 0;
+    for (std::size_t i = 1; i <= count; ++i) {
+        const std::size_t end = std::max (begin, starts[i]);
+        if (end > begin) chunks.push_back (data.substr (begin, end - begin));
+        begin = end;
+    }
+    return chunks;
+}
+
+void
+parse_parallel (
+    std::string_view                data,
+    gpw::concurrency::thread_pool& pool,
+    const chunk_handler&            on_chunk,
+    csv_dialect                     dialect,
+    std::size_t                     chunk_size
+) {
+    const std::size_t count  = data.length() / std::max<std::size_t> (chunk_size, 1) + 1;
+    const auto        chunks = split_records (data, count, pool, dialect);
+
+    gpw::concurrency::first_exception error;
+    gpw::concurrency::latch           done (chunks.size());
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        pool.queue_job ([&, i] {
+            try {
+                csv_parser parser{chunks[i], dialect};
+                on_chunk (i, parser);
+            } catch (...) {
+                error.capture();
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    error.rethrow();
+}
+
+}  // namespace gpw::str
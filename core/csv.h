@@ -0,0 +1,125 @@
+// -----------------------------------------------------------------------------
+// Delimited records (CSV, TSV)
+// -----------------------------------------------------------------------------
+#ifndef gpw_csv_h
+#define gpw_csv_h
+
+#include "core/concurrency.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace gpw::str {
+
+struct csv_dialect {
+    char delimiter = ',';
+    char quote     = '"';
+};
+
+inline constexpr csv_dialect tsv_dialect{'\t', '"'};
+
+// Record parser
+//
+// Parses delimited records following RFC 4180: fields may be quoted, a quote
+// inside a quoted field is doubled, and quoted fields may contain delimiters
+// and newlines.  Records end with "\n" or "\r\n".
+//
+// The structural characters are found 64 bytes at a time: SIMD compares give
+// bit masks of the quotes, delimiters and newlines, a prefix XOR of the quote
+// mask tells which bytes are inside quotes, and the remaining delimiters and
+// newlines are visited bit by bit.  A quote in the middle of an unquoted field
+// is not supported.
+//
+// The fields are string_views into the data, except the ones with doubled
+// quotes, which are unescaped into a buffer of the parser.  They stay valid
+// until the next call to next().
+//
+//   csv_parser parser{data};
+//   std::vector<std::string_view> fields;
+//   while (parser.next (fields))
+//     ...
+class csv_parser {
+  public:
+    explicit csv_parser (std::string_view data, csv_dialect dialect = {})
+        : _data{data}, _dialect{dialect} {}
+
+    // Parses the next record into fields, replacing its contents but reusing
+    // its capacity.  Returns false at the end of the data.
+    bool
+    next (std::vector<std::string_view>& fields);
+
+    // Offset of the next record in the data
+    std::size_t
+    offset () const {
+        return _pos;
+    }
+
+  private:
+    std::size_t
+    _next_structural ();
+
+    void
+    _add_field (
+        std::vector<std::string_view>& fields, std::size_t begin, std::size_t end, bool eol
+    );
+
+    std::string_view _data;
+    csv_dialect      _dialect;
+    std::size_t      _pos = 0;
+
+    // Structural characters of the block starting at _block not yet visited,
+    // and the quote state at the end of the block (all ones inside quotes)
+    std::size_t   _block      = 0;
+    std::size_t   _next_block = 0;
+    std::uint64_t _structural = 0;
+    std::uint64_t _inside     = 0;
+
+    // Unescaped fields of the current record: (field index, offset in
+    // _unescaped, length), resolved once the buffer has stopped growing
+    using pending_field = std::tuple<std::size_t, std::size_t, std::size_t>;
+    std::string                _unescaped;
+    std::vector<pending_field> _pending;
+};
+
+// Splits data into at most count chunks which begin and end at record
+// boundaries, so that they can be parsed independently.  The pool must have
+// been started.  The quote state at
+// the equally sized raw splits is resolved with a fix-up pass: the quote
+// parities of the splits are counted in parallel, combined with a prefix XOR,
+// and then each split is advanced to the first newline outside quotes.
+std::vector<std::string_view>
+split_records (
+    std::string_view                data,
+    std::size_t                     count,
+    gpw::concurrency::thread_pool& pool,
+    csv_dialect                     dialect = {}
+);
+
+using chunk_handler = std::function<void (std::size_t, csv_parser&)>;
+
+constexpr std::size_t default_csv_chunk_size = 4 << 20;
+
+// Parses data in parallel on the pool: the data is split by split_records into
+// chunks of about chunk_size bytes, and each chunk is handed to on_chunk with
+// its index and a parser positioned at its first record.  on_chunk is called
+// concurrently from the jobs of the pool.  The pool must have been started,
+// and this function must not be called from one of its jobs.  If on_chunk
+// throws, the other chunks are still parsed, and the first exception is
+// rethrown once all of them are done.
+void
+parse_parallel (
+    std::string_view                data,
+    gpw::concurrency::thread_pool& pool,
+    const chunk_handler&            on_chunk,
+    csv_dialect                     dialect    = {},
+    std::size_t                     chunk_size = default_csv_chunk_size
+);
+
+}  // namespace gpw::str
+
+#endif
@@ -1,89 +1,323 @@
 #include "core/date_time.h"
+#include "core/number.h"
 #include "core/str.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 
+#if defined(GPW_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#endif
+
 namespace gpw::util::dt {
 
+namespace {
+
+long long
+floor_div (long long a, long long b) {
+    return a / b - (a % b < 0);
+}
+
+// Days from the epoch to a date of the proleptic Gregorian calendar, and back
+// (Howard Hinnant's algorithms, with eras of 400 years starting on March 1)
+long long
+days_from_civil (long long year, int month, int day) {
+    year -= month <= 2;
+    const long long era = floor_div (year, 400);
+    const auto      yoe = static_cast<unsigned> (year - era * 400);
+    const unsigned  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void
+civil_from_days (long long days, civil_time& ct) {
+    days += 719468;
+    const long long era = floor_div (days, 146097);
+    const auto      doe = static_cast<unsigned> (days - era * 146097);
+    const unsigned  yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned  doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned  mp  = (5 * doy + 2) / 153;
+    ct.day              = static_cast<int> (doy - (153 * mp + 2) / 5 + 1);
+    ct.month            = static_cast<int> (mp < 10 ? mp + 3 : mp - 9);
+    ct.year             = static_cast<int> (yoe + era * 400 + (ct.month <= 2));
+}
+
+// The UTC offset of a thread, valid for the seconds [from, until)
+struct offset_cache {
+    long long from   = 0;
+    long long until  = 0;
+    long      offset = 0;
+};
+
+thread_local offset_cache cached_offset;
+
+char*
+write_2_digits (int value, char* dst) {
+    dst[0] = static_cast<char> ('0' + value / 10);
+    dst[1] = static_cast<char> ('0' + value % 10);
+    return dst + 2;
+}
+
+char*
+write_msec (int msec, char* dst) {
+    *dst++ = '.';
+    *dst++ = static_cast<char> ('0' + msec / 100);
+    return write_2_digits (msec % 100, dst);
+}
+
+// Parsing of time stamps
+
+bool
+is_digit (char c) {
+    return static_cast<unsigned char> (c - '0') < 10;
+}
+
+int
+two_digits (const char* p) {
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+std::uint64_t
+load8 (const char* p) {
+    std::uint64_t word;
+    std::memcpy (&word, p, sizeof word);
+    return word;
+}
+
+// True if the bytes of word where mask has 0xff are decimal digits: their high
+// nibble must be 3, and stay 3 when 6 is added to the low one.  A byte of 0xfa
+// or more carries into the next one, which may fail it, but such a string is
+// invalid anyway.
+bool
+are_digits (std::uint64_t word, std::uint64_t mask) {
+    constexpr std::uint64_t high  = 0xf0f0f0f0f0f0f0f0;
+    constexpr std::uint64_t zeros = 0x3030303030303030;
+    constexpr std::uint64_t sixes = 0x0606060606060606;
+    return ((((word & high) ^ zeros) | (((word + sixes) & high) ^ zeros)) & mask) == 0;
+}
+
+int
+days_in_month (int year, int month) {
+    static constexpr int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    const bool           leap   = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return (month == 2 && leap) ? 29 : days[month - 1];
+}
+
+// Seconds from the epoch of a local time, with the offset in effect then
+long long
+local_to_utc (long long local) {
+    const offset_cache& cache = cached_offset;
+    if (local >= cache.from + cache.offset && local < cache.until + cache.offset)
+        return local - cache.offset;
+
+    const long guess = utc_offset (local);
+    return local - utc_offset (local - guess);
+}
+
+// The date of the previous time stamp of a column
+struct date_cache {
+    char      date[10];
+    long long days  = 0;
+    bool      valid = false;
+};
+
+// Parses a time stamp (see parse_time_stamp) into seconds from the epoch and
+// nanoseconds.
+std::errc
+parse_time (std::string_view str, long long& secs, long& nsec, date_cache& cache) {
+    constexpr auto    invalid = std::errc::invalid_argument;
+    const char*       p       = str.data();
+    const std::size_t n       = str.length();
+    if (n < 10) return invalid;
+
+    // "YYYY-MM-DD"
+    long long days;
+    if (cache.valid && std::memcmp (p, cache.date, 10) == 0) {
+        days = cache.days;
+    } else {
+        const std::uint64_t digits = load8 ("\xff\xff\xff\xff\0\xff\xff\0");
+        if (!are_digits (load8 (p), digits) || p[4] != '-' || p[7] != '-' || !is_digit (p[8])
+            || !is_digit (p[9]))
+            return invalid;
+        const int year  = two_digits (p) * 100 + two_digits (p + 2);
+        const int month = two_digits (p + 5);
+        const int day   = two_digits (p + 8);
+        if (month < 1 || month > 12 || day < 1 || day > days_in_month (year, month)) return invalid;
+
+        days = days_from_civil (year, month, day);
+        std::memcpy (cache.date, p, 10);
+        cache.days  = days;
+        cache.valid = true;
+    }
+    secs = days * 86400;
+    nsec = 0;
+
+    // "THH:MM:SS" or "THH-MM-SS", then the fraction
+    std::size_t i = 10;
+    if (n > 10) {
+        if (n < 19 || (p[10] != 'T' && p[10] != 't' && p[10] != ' ')) return invalid;
+        const std::uint64_t digits = load8 ("\xff\xff\0\xff\xff\0\xff\xff");
+        const char          sep    = p[13];
+        if (!are_digits (load8 (p + 11), digits) || (sep != ':' && sep != '-') || p[16] != sep)
+            return invalid;
+        const int hour   = two_digits (p + 11);
+        const int minute = two_digits (p + 14);
+        const int second = two_digits (p + 17);
+        if (hour > 23 || minute > 59 || second > 60) return invalid;
+        secs += hour * 3600 + minute * 60 + second;
+
+        i = 19;
+        if (i < n && (p[i] == '.' || p[i] == ',')) {
+            static constexpr long scale[] = {1000000000, 100000000, 10000000, 1000000, 100000,
+                                             10000,      1000,      100,      10,      1};
+            const std::size_t first = ++i;
+            int               count = 0;
+            for (; i < n && is_digit (p[i]); ++i) {
+                if (count < 9) {
+                    nsec = nsec * 10 + (p[i] - '0');
+                    ++count;
+                }
+            }
+            if (i == first) return invalid;
+            nsec *= scale[count];
+        }
+    }
+
+    // Time zone
+    if (i == n) {
+        secs = local_to_utc (secs);
+    } else if ((n - i == 1 && (p[i] == 'Z' || p[i] == 'z')) || str.substr (i) == "-UTC") {
+        // UTC
+    } else if (p[i] == '+' || p[i] == '-') {
+        const char*       z      = p + i + 1;
+        const std::size_t length = n - i - 1;
+        int               hours  = 0;
+        int               mins   = 0;
+        if (length == 2 || length == 4 || (length == 5 && z[2] == ':')) {
+            // Digits everywhere but the ':' of "+hh:mm"
+            for (std::size_t j = 0; j < length; ++j)
+                if (!(length == 5 && j == 2) && !is_digit (z[j])) return invalid;
+            hours = two_digits (z);
+            if (length > 2) mins = two_digits (z + length - 2);
+        } else {
+            return invalid;
+        }
+        if (hours < 0 || hours > 23 || mins < 0 || mins > 59) return invalid;
+        const int offset = hours * 3600 + mins * 60;
+        secs -= (p[i] == '-') ? -offset : offset;
+    } else {
+        return invalid;
+    }
+    return std::errc{};
+}
+
+template <typename Convert>
+std::size_t
+parse_time_column (
+    const std::vector<std::string_view>& fields, std::vector<long long>& out, Convert convert
+) {
+    std::size_t first_error = std::string_view::npos;
+    date_cache  cache;
+    out.resize (fields.size());
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        long long secs;
+        long      nsec;
+        std::errc error = parse_time (fields[i], secs, nsec, cache);
+        out[i]          = 0;
+        if (error == std::errc{}) error = convert (secs, nsec, out[i]);
+        if (error != std::errc{}) first_error = std::min (first_error, i);
+    }
+    return first_error;
+}
+
+std::errc
+to_msec (long long secs, long nsec, long long& msecs) {
+    msecs = secs * 1000 + nsec / 1000000;
+    return std::errc{};
+}
+
+std::errc
+to_nsec (long long secs, long nsec, long long& nsecs) {
+    // From 1677-09-21 to 2262-04-11
+    constexpr long long limit = std::numeric_limits<long long>::max() / 1000000000 - 1;
+    if (secs > limit || secs < -limit) return std::errc::result_out_of_range;
+    nsecs = secs * 1000000000 + nsec;
+    return std::errc{};
+}
+
+}  // namespace
+
 time_point
 now () {
-    return std::chrono::high_resolution_clock::now();
+    return std::chrono::steady_clock::now();
 }
 
 double
 duration_msec (const time_point& since) {
-    return std::chrono::duration_cast<std::chrono::milliseconds> (now() - since).count();
+    return std::chrono::duration<double, std::milli> (now() - since).count();
+}
+
+bool
+tsc_clock::has_invariant_tsc () {
+    // Bit 8 of EDX of CPUID leaf 0x80000007 (advanced power management)
+#if defined(GPW_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max (0x80000000, nullptr) < 0x80000007) return false;
+    __cpuid (0x80000007, eax, ebx, ecx, edx);
+    return (edx & (1u << 8)) != 0;
+#elif defined(GPW_SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid (info, 0x80000000);
+    if (static_cast<unsigned int> (info[0]) < 0x80000007) return false;
+    __cpuid (info, 0x80000007);
+    return (info[3] & (1 << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+double
+tsc_clock::nsec_per_tick () {
+    static const double rate = [] {
+        if (!is_tsc()) return 1.0;
+
+        // Spin rather than sleep, so that a descheduled thread does not skew
+        // the pair of readings at either end.
+        const std::int64_t  nsec_start  = now_nsec();
+        const std::uint64_t ticks_start = ticks();
+        std::int64_t        nsec_end;
+        do {
+            nsec_end = now_nsec();
+        } while (nsec_end - nsec_start < 10000000);
+        const std::uint64_t ticks_end = ticks();
+        return static_cast<double> (nsec_end - nsec_start)
+             / static_cast<double> (ticks_end - ticks_start);
+    }();
+    return rate;
 }
 
 const std::string
 current_time (const bool& readable) {
-    std::time_t now = std::time (nullptr);
-    std::tm     tstruct;
-    char        buf[16];
-    tstruct = *std::localtime (&now);
-    const char* fmt;
-    if (readable) {
-        fmt = "%H:%M:%S";
-    } else {
-        fmt = "%H%M%S";
-    }
-    std::strftime (buf, sizeof (buf), fmt, &tstruct);
-    return buf;
+    char buf[max_time_stamp_length];
+    return std::string (buf, format_time (now_msec(), readable, false, buf));
 }
 
 const std::string
 current_time_milli (const bool& readable) {
-    // The system_clock class is the interface in C++ to get system-wide
-    // real-time wall clock.  Most systems use Unix time, which is represented
-    // as seconds past from 00:00:00 UTC on 1 January 1970 (an arbitrary date),
-    // called Unix epoch. Note that leap seconds are ignored.  Thus Unix time is
-    // not truly an accurate representation of UTC.
-    //
-    // Firstly, the now() method is called to return the current point in time.
-    // The next method called is time_since_epoch to retrieve the amount of time
-    // between *this and the clock's epoch, but it returns an duration
-    // class object.  This object should call the count method to return the
-    // actual number of ticks, and to represent it as milliseconds.  The result
-    // is cast using duration_cast<milliseconds>.
-    auto now = std::chrono::system_clock::now();
-    auto ms_since_epoch =
-        std::chrono::duration_cast<std::chrono::milliseconds> (now.time_since_epoch()).count();
-    auto ms_str              = std::to_string (ms_since_epoch % 1000);
-    auto count_leading_zeros = 3 - ms_str.length();
-
-    std::stringstream strm{};
-    auto              now_c = std::chrono::system_clock::to_time_t (now);
-
-    const char* fmt;
-    if (readable) {
-        fmt = "%H:%M:%S";
-    } else {
-        fmt = "%H%M%S";
-    }
-    strm << std::put_time (std::localtime (&now_c), fmt) << ".";
-    for (int i = 0; i < count_leading_zeros; i++) {
-        strm << "0";
-    }
-    strm << ms_str;
-
-    return strm.str();
+    char buf[max_time_stamp_length];
+    return std::string (buf, format_time (now_msec(), readable, true, buf));
 }
 
 const std::string
 current_date (const bool& readable) {
-    std::time_t now = std::time (nullptr);
-    std::tm     tstruct;
-    char        buf[80];
-    tstruct = *std::localtime (&now);
-    const char* fmt;
-    if (readable) {
-        fmt = "%Y-%m-%d";
-    } else {
-        fmt = "%Y%m%d";
-    }
-    std::strftime (buf, sizeof (buf), fmt, &tstruct);
-    return buf;
+    char buf[max_time_stamp_length];
+    return std::string (buf, format_date (now_msec(), readable, buf));
 }
 
 // String representation of the seconds from the epoch of time (Thu. Jan. 1,
@@ -169,41 +403,146 @@ to_string (const std::chrono::duration<double>& seconds) {
 
 std::string
 time_stamp (long long msecs, bool show_msec, bool utc) {
-    using std::setfill;
-    using std::setw;
+    char buf[max_time_stamp_length];
+    return std::string (buf, format_time_stamp (msecs, show_msec, utc, buf));
+}
 
-    std::time_t        t  = msecs / 1000;
-    int                ms = msecs % 1000;
-    std::ostringstream oss;
+std::string
+time_stamp (bool show_msec) {
+    return time_stamp (now_msec(), show_msec, false);
+}
+
+std::string
+time_stamp_utc (bool show_msec) {
+    return time_stamp (now_msec(), show_msec, true);
+}
+
+long long
+now_msec () {
+    // Most systems use Unix time for the system clock, which is represented as
+    // the seconds from 00:00:00 UTC on 1 January 1970, called Unix epoch.
+    // Note that leap seconds are ignored.  Thus Unix time is not truly an
+    // accurate representation of UTC.
+    return std::chrono::duration_cast<std::chrono::milliseconds> (
+               std::chrono::system_clock::now().time_since_epoch()
+    )
+        .count();
+}
 
+long
+utc_offset (long long secs) {
+    offset_cache& cache = cached_offset;
+    if (secs >= cache.from && secs < cache.until) return cache.offset;
+
+    const auto t = static_cast<std::time_t> (secs);
+    std::tm    tm{};
+#if defined(_WIN32)
+    localtime_s (&tm, &t);
+#else
+    localtime_r (&t, &tm);
+#endif
+    const long long local = days_from_civil (tm.tm_year + 1900LL, tm.tm_mon + 1, tm.tm_mday) * 86400
+                          + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+
+    // Time zones change their offsets at the start of a local hour, so the
+    // offset holds for the whole local hour.
+    cache.offset = static_cast<long> (local - secs);
+    cache.from   = secs - (local - floor_div (local, 3600) * 3600);
+    cache.until  = cache.from + 3600;
+    return cache.offset;
+}
+
+civil_time
+to_civil (long long msecs, bool utc) {
+    long long secs = floor_div (msecs, 1000);
+    civil_time ct;
+    ct.msec = static_cast<int> (msecs - secs * 1000);
+    if (!utc) secs += utc_offset (secs);
+
+    const long long days = floor_div (secs, 86400);
+    auto            rem  = static_cast<int> (secs - days * 86400);
+    civil_from_days (days, ct);
+    ct.hour   = rem / 3600;
+    rem      %= 3600;
+    ct.minute = rem / 60;
+    ct.second = rem % 60;
+    return ct;
+}
+
+char*
+format_time_stamp (long long msecs, bool show_msec, bool utc, char* dst) {
+    const civil_time ct = to_civil (msecs, utc);
+    dst                 = gpw::str::format_int (ct.year, dst);
+    *dst++              = '-';
+    dst                 = write_2_digits (ct.month, dst);
+    *dst++              = '-';
+    dst                 = write_2_digits (ct.day, dst);
+    *dst++              = 'T';
+    dst                 = write_2_digits (ct.hour, dst);
+    *dst++              = '-';
+    dst                 = write_2_digits (ct.minute, dst);
+    *dst++              = '-';
+    dst                 = write_2_digits (ct.second, dst);
+    if (show_msec) dst = write_msec (ct.msec, dst);
     if (utc) {
-        oss << std::put_time (std::gmtime (&t), "%Y-%m-%dT%H-%M-%S");
-        if (show_msec) oss << "." << setfill ('0') << setw (3) << ms;
-        oss << "-UTC";
-    } else {
-        oss << std::put_time (std::localtime (&t), "%Y-%m-%dT%H-%M-%S");
-        if (show_msec) oss << "." << setfill ('0') << setw (3) << ms;
+        for (const char c : {'-', 'U', 'T', 'C'})
+            *dst++ = c;
     }
+    return dst;
+}
 
-    return oss.str();
+char*
+format_time (long long msecs, bool readable, bool show_msec, char* dst) {
+    const civil_time ct = to_civil (msecs, false);
+    dst                 = write_2_digits (ct.hour, dst);
+    if (readable) *dst++ = ':';
+    dst = write_2_digits (ct.minute, dst);
+    if (readable) *dst++ = ':';
+    dst = write_2_digits (ct.second, dst);
+    if (show_msec) dst = write_msec (ct.msec, dst);
+    return dst;
 }
 
-std::string
-time_stamp (bool show_msec) {
-    std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds> (
-        std::chrono::system_clock::now().time_since_epoch()
-    );
+char*
+format_date (long long msecs, bool readable, char* dst) {
+    const civil_time ct = to_civil (msecs, false);
+    dst                 = gpw::str::format_int (ct.year, dst);
+    if (readable) *dst++ = '-';
+    dst = write_2_digits (ct.month, dst);
+    if (readable) *dst++ = '-';
+    return write_2_digits (ct.day, dst);
+}
 
-    return time_stamp (ms.count(), show_msec, false);
+gpw::str::parse_result<long long>
+parse_time_stamp (std::string_view str) {
+    gpw::str::parse_result<long long> result;
+    date_cache                        cache;
+    long long                         secs;
+    long                              nsec;
+    result.error = parse_time (str, secs, nsec, cache);
+    if (result) result.error = to_msec (secs, nsec, result.value);
+    return result;
 }
 
-std::string
-time_stamp_utc (bool show_msec) {
-    std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds> (
-        std::chrono::system_clock::now().time_since_epoch()
-    );
+gpw::str::parse_result<long long>
+parse_time_stamp_nsec (std::string_view str) {
+    gpw::str::parse_result<long long> result;
+    date_cache                        cache;
+    long long                         secs;
+    long                              nsec;
+    result.error = parse_time (str, secs, nsec, cache);
+    if (result) result.error = to_nsec (secs, nsec, result.value);
+    return result;
+}
+
+std::size_t
+parse_time_stamp (const std::vector<std::string_view>& fields, std::vector<long long>& out) {
+    return parse_time_column (fields, out, to_msec);
+}
 
-    return time_stamp (ms.count(), show_msec, true);
+std::size_t
+parse_time_stamp_nsec (const std::vector<std::string_view>& fields, std::vector<long long>& out) {
+    return parse_time_column (fields, out, to_nsec);
 }
 
 }  // namespace gpw::util::dt
@@ -1,15 +1,30 @@
 // -----------------------------------------------------------------------------
 // Date & Time
 // -----------------------------------------------------------------------------
+#ifndef gpw_date_time_h
+#define gpw_date_time_h
 
+#include "core/number.h"
+#include "core/simd.h"
+
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
+
+#if defined(GPW_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#endif
 
 namespace gpw::util::dt {
 
-// Measure time of execution of a function
-using time_point = std::chrono::high_resolution_clock::time_point;
+// Measure time of execution of a function, in milliseconds with a fraction,
+// on the monotonic clock
+using time_point = std::chrono::steady_clock::time_point;
 
 time_point
 now ();
@@ -25,6 +40,122 @@ measure_time_msec (F func, Args&&... args) {
     return duration_msec (t1);
 }
 
+// Nanoseconds of the monotonic clock (steady_clock) from an unspecified start
+inline std::int64_t
+now_nsec () {
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+// Time stamp counter clock
+//
+// Reads the time stamp counter of the processor (rdtsc), which takes a few
+// nanoseconds where steady_clock takes some tens, and converts the ticks to
+// time with a rate calibrated against steady_clock on first use.  The counter
+// is used only if it is invariant: running at a constant rate in all power
+// states, and synchronized across cores.  Otherwise, and on processors other
+// than x86-64, the ticks are the nanoseconds of now_nsec().
+class tsc_clock {
+  public:
+    // True if the ticks come from the time stamp counter
+    static bool
+    is_tsc () {
+        static const bool invariant = has_invariant_tsc();
+        return invariant;
+    }
+
+    static std::uint64_t
+    ticks () {
+#if defined(GPW_SIMD_X86)
+        if (is_tsc()) return __rdtsc();
+#endif
+        return static_cast<std::uint64_t> (now_nsec());
+    }
+
+    // Calibrates on the first call, which takes about 10 ms.
+    static double
+    nsec_per_tick ();
+
+    static double
+    to_nsec (std::uint64_t ticks) {
+        return static_cast<double> (ticks) * nsec_per_tick();
+    }
+
+  private:
+    static bool
+    has_invariant_tsc ();
+};
+
+// Total time and number of runs of a code region.  Updated with relaxed
+// atomics, so a counter can be shared by threads.
+class alignas (64) time_counter {
+  public:
+    void
+    add (std::uint64_t ticks) {
+        _ticks.fetch_add (ticks, std::memory_order_relaxed);
+        _count.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t
+    count () const {
+        return _count.load (std::memory_order_relaxed);
+    }
+
+    // In tsc_clock ticks
+    std::uint64_t
+    ticks () const {
+        return _ticks.load (std::memory_order_relaxed);
+    }
+
+    double
+    total_nsec () const {
+        return tsc_clock::to_nsec (ticks());
+    }
+
+    double
+    mean_nsec () const {
+        const std::uint64_t n = count();
+        return n == 0 ? 0.0 : total_nsec() / static_cast<double> (n);
+    }
+
+    void
+    reset () {
+        _ticks.store (0, std::memory_order_relaxed);
+        _count.store (0, std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<std::uint64_t> _ticks{0};
+    std::atomic<std::uint64_t> _count{0};
+};
+
+// Adds the time from its construction to its destruction to a counter:
+//
+//   static dt::time_counter parse_time;
+//   {
+//       dt::scoped_timer timer{parse_time};
+//       parse (line);
+//   }
+//   std::cout << parse_time.mean_nsec() << " ns per line";
+class scoped_timer {
+  public:
+    explicit scoped_timer (time_counter& counter)
+        : _counter{counter}, _start{tsc_clock::ticks()} {}
+
+    scoped_timer (const scoped_timer&)            = delete;
+    scoped_timer& operator= (const scoped_timer&) = delete;
+
+    ~scoped_timer () {
+        _counter.add (tsc_clock::ticks() - _start);
+    }
+
+  private:
+    time_counter& _counter;
+    std::uint64_t _start;
+};
+
 // Get string of time
 const std::string
 current_time (const bool& readable = false);
@@ -58,4 +189,93 @@ time_stamp_utc (bool show_msec = false);
 std::string
 time_stamp (long long msec, bool show_msec, bool utc);
 
+// Thread safe conversions
+//
+// Unlike std::localtime and std::gmtime, these do not return a pointer to
+// shared state, and they do not look up the time zone for every call: UTC
+// dates are computed arithmetically and local ones by adding the UTC offset,
+// which each thread caches until the start of the next local hour (the hour or
+// DST boundary where the offset may change).  The functions above are built on
+// them.
+
+// Broken down time
+struct civil_time {
+    int year;
+    int month;  // 1 to 12
+    int day;    // 1 to 31
+    int hour;
+    int minute;
+    int second;
+    int msec;
+};
+
+// Milliseconds from the epoch of the system clock
+long long
+now_msec ();
+
+// Offset of the local time from UTC in seconds at the given seconds from the
+// epoch, e.g. 3600 for CET
+long
+utc_offset (long long secs);
+
+civil_time
+to_civil (long long msecs, bool utc);
+
+// Formatting into caller buffers: each function writes the same characters as
+// its std::string counterpart above to dst, which must have room for
+// max_time_stamp_length characters, and returns the end of the output.
+constexpr std::size_t max_time_stamp_length = 32;
+
+// "%Y-%m-%dT%H-%M-%S", then ".mmm" if show_msec and "-UTC" if utc
+char*
+format_time_stamp (long long msecs, bool show_msec, bool utc, char* dst);
+
+// Local "%H:%M:%S" if readable, else "%H%M%S", then ".mmm" if show_msec
+char*
+format_time (long long msecs, bool readable, bool show_msec, char* dst);
+
+// Local "%Y-%m-%d" if readable, else "%Y%m%d"
+char*
+format_date (long long msecs, bool readable, char* dst);
+
+// Parsing of time stamps, the inverse of time_stamp
+//
+// Accepts the output of time_stamp, "%Y-%m-%dT%H-%M-%S" with optional
+// milliseconds and "-UTC", and ISO 8601 dates and times in the extended
+// format:
+//
+//   2024-03-09T14-05-09.250-UTC       time_stamp (msecs, true, true)
+//   2024-03-09T14:05:09.250123Z       UTC
+//   2024-03-09 14:05:09,25+09:00      Offset from UTC (also +0900 or +09)
+//   2024-03-09T14:05:09               Local time
+//   2024-03-09                        Local midnight
+//
+// The separator of the date and the time is 'T', 't' or a space, the fraction
+// of a second has 1 to 9 digits (more are truncated), and the time zone is
+// "-UTC", 'Z', 'z', an offset, or nothing for the local time (see utc_offset;
+// in the hour repeated when DST ends, either time may be chosen).  The fixed
+// fields are checked 8 bytes at a time.  Errors are reported like parse_int:
+// invalid_argument for a malformed string or invalid date, and
+// result_out_of_range for nanoseconds out of the range of long long.
+
+// Milliseconds from the epoch
+gpw::str::parse_result<long long>
+parse_time_stamp (std::string_view str);
+
+// Nanoseconds from the epoch
+gpw::str::parse_result<long long>
+parse_time_stamp_nsec (std::string_view str);
+
+// Parses a column of time stamps into out (resized to the number of fields),
+// reusing the date of the previous field when it is the same, as in sorted
+// logs.  Fields which are not time stamps get the value 0.  Returns the index
+// of the first of them, or npos if all the fields were parsed.
+std::size_t
+parse_time_stamp (const std::vector<std::string_view>& fields, std::vector<long long>& out);
+
+std::size_t
+parse_time_stamp_nsec (const std::vector<std::string_view>& fields, std::vector<long long>& out);
+
 }  // namespace gpw::util::dt
+
+#endif
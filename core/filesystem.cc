@@ -1,12 +1,212 @@
 #include "core/filesystem.h"
 #include "core/log.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <memory>
 #include <regex>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 27)
+#define GPW_HAS_COPY_FILE_RANGE 1
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 28) && defined(RENAME_NOREPLACE)
+#define GPW_HAS_RENAME_NOREPLACE 1
+#endif
+#endif
 
 namespace gpw::filesystem {
 
+namespace {
+
+#if defined(__linux__)
+// Closes a file descriptor at the end of the scope
+struct fd_guard {
+    int fd;
+
+    ~fd_guard () {
+        ::close (fd);
+    }
+};
+
+std::runtime_error
+copy_error (const char* what, const fs::path& path) {
+    return std::runtime_error{
+        std::string{what} + " '" + path.string() + "': " + std::strerror (errno)
+    };
+}
+
+// Whether a kernel copy failed because the files do not support it, rather
+// than because of an I/O error
+bool
+is_unsupported (int error) {
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP
+        || error == ETXTBSY;
+}
+
+// Copies with the kernel call copy (copy_file_range or sendfile), which
+// copies from the file offsets and advances them, until the end of the file.
+// Returns false if the files do not support it; the offsets are then where
+// the copy stopped, for the next mechanism to go on.
+template <typename F>
+bool
+copy_in_kernel (F copy, const fs::path& src) {
+    for (;;) {
+        const ssize_t count = copy (std::size_t{1} << 30);
+        if (count > 0) continue;
+        if (count == 0) return true;
+        if (errno == EINTR) continue;
+        if (is_unsupported (errno)) return false;
+        throw copy_error ("Cannot copy", src);
+    }
+}
+
+// Returns the number of bytes copied.
+std::uint64_t
+copy_buffered (int in, int out, const fs::path& src) {
+    constexpr std::size_t   buffer_size = std::size_t{1} << 20;
+    std::unique_ptr<char[]> buffer{new char[buffer_size]};
+    std::uint64_t           copied = 0;
+    for (;;) {
+        const ssize_t count = ::read (in, buffer.get(), buffer_size);
+        if (count == 0) return copied;
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw copy_error ("Cannot read", src);
+        }
+        for (ssize_t written = 0; written < count;) {
+            const ssize_t n = ::write (out, buffer.get() + written, count - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw copy_error ("Cannot write the copy of", src);
+            }
+            written += n;
+        }
+        copied += count;
+    }
+}
+
+copy_method
+copy_contents (int in, int out, const struct stat& status, const fs::path& src) {
+    // Pseudo files (e.g. in /proc) report a size of 0, and the kernel copies
+    // find them empty.  An empty file is reported as nothing to copy.
+    if (status.st_size == 0)
+        return copy_buffered (in, out, src) > 0 ? copy_method::buffered : copy_method::none;
+#if defined(FICLONE)
+    if (::ioctl (out, FICLONE, in) == 0) return copy_method::reflink;
+#endif
+#if defined(GPW_HAS_COPY_FILE_RANGE)
+    const auto copy_range = [in, out] (std::size_t count) {
+        return ::copy_file_range (in, nullptr, out, nullptr, count, 0);
+    };
+    if (copy_in_kernel (copy_range, src)) return copy_method::copy_file_range;
+#endif
+    const auto send = [in, out] (std::size_t count) {
+        return ::sendfile (out, in, nullptr, count);
+    };
+    if (copy_in_kernel (send, src)) return copy_method::sendfile;
+    copy_buffered (in, out, src);
+    return copy_method::buffered;
+}
+#endif
+
+// Name of item at the destination: the name of a link, not of its target
+fs::path
+item_name (const fs::path& item) {
+    fs::path path = item.lexically_normal();
+    if (!path.has_filename()) path = path.parent_path();  // Trailing separator
+    const fs::path name = path.filename();
+    if (name.empty() || name == "." || name == "..") return fs::canonical (item).filename();
+    return name;
+}
+
+std::runtime_error
+exists_error (const fs::path& target) {
+    return std::runtime_error{"The destination '" + target.string() + "' already exists"};
+}
+
+// Renames item to target if they are on the same device.  Returns false if
+// it must be copied instead.  Throws runtime_error if target exists, which a
+// rename would replace.
+bool
+rename_on_same_device (const fs::path& item, const fs::path& target) {
+    std::error_code error;
+    if (fs::exists (fs::symlink_status (target, error))) throw exists_error (target);
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat item_status, dst_status;
+    if (::lstat (item.c_str(), &item_status) != 0
+        || ::stat (target.parent_path().c_str(), &dst_status) != 0
+        || item_status.st_dev != dst_status.st_dev)
+        return false;
+#endif
+#if defined(GPW_HAS_RENAME_NOREPLACE)
+    // Fails rather than replace a target created since the check, unless
+    // the filesystem does not support the flag (EINVAL).
+    if (::renameat2 (AT_FDCWD, item.c_str(), AT_FDCWD, target.c_str(), RENAME_NOREPLACE) == 0)
+        return true;
+    if (errno == EEXIST) throw exists_error (target);
+    if (errno != EINVAL && errno != ENOSYS) return false;
+#endif
+    // Fails across the mount points of a device too (EXDEV).
+    fs::rename (item, target, error);
+    return !error;
+}
+
+// Copies item to target, which must not exist, recursively for a directory.
+// Symbolic links are copied as links.  Returns the slowest method used.
+copy_method
+copy_tree (const fs::path& item, const fs::path& target) {
+    const auto status = fs::symlink_status (item);
+    if (fs::is_symlink (status)) {
+        fs::copy_symlink (item, target);
+        return copy_method::none;
+    }
+    if (!fs::is_directory (status)) return copy_regular_file (item, target);
+
+    if (!fs::create_directory (target, item)) throw exists_error (target);
+    copy_method slowest = copy_method::none;
+    for (const auto& entry : fs::directory_iterator (item))
+        slowest = std::max (slowest, copy_tree (entry.path(), target / entry.path().filename()));
+    return slowest;
+}
+
+// Copies item to target with copy_tree, removing what was copied if it fails.
+copy_method
+copy_or_clean_up (const fs::path& item, const fs::path& target) {
+    std::error_code error;
+    if (fs::exists (fs::symlink_status (target, error))) throw exists_error (target);
+    try {
+        return copy_tree (item, target);
+    } catch (...) {
+        fs::remove_all (target, error);
+        throw;
+    }
+}
+
+copy_method
+move_tree (const fs::path& item, const fs::path& target) {
+    if (rename_on_same_device (item, target)) return copy_method::rename;
+    const copy_method method = copy_or_clean_up (item, target);
+    fs::remove_all (item);
+    return method;
+}
+
+}  // namespace
+
 std::string
 append_suffix (const std::string& file_name, const std::string& suffix) {
     const auto pos       = file_name.find_last_of ('.');
@@ -58,57 +258,86 @@ directory_exists (const std::string_view& name, const fs::path& dir) {
     return false;
 }
 
+std::string_view
+to_string (copy_method method) {
+    switch (method) {
+        case copy_method::none:            return "none";
+        case copy_method::rename:          return "rename";
+        case copy_method::reflink:         return "reflink";
+        case copy_method::copy_file_range: return "copy_file_range";
+        case copy_method::sendfile:        return "sendfile";
+        case copy_method::buffered:        return "buffered";
+    }
+    return "unknown";
+}
+
+// Copy a regular file with the fastest mechanism available
+copy_method
+copy_regular_file (const fs::path& src, const fs::path& dst) {
+#if defined(__linux__)
+    // Without blocking on a FIFO, which is not a regular file anyway
+    const int in = ::open (src.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (in < 0) throw copy_error ("Cannot open", src);
+    const fd_guard in_guard{in};
+
+    struct stat status;
+    if (::fstat (in, &status) != 0) throw copy_error ("Cannot stat", src);
+    if (!S_ISREG (status.st_mode))
+        throw std::runtime_error{"Not a regular file '" + src.string() + "'"};
+
+    const int out =
+        ::open (dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (out < 0) throw copy_error ("Cannot create", dst);
+    const fd_guard out_guard{out};
+
+    try {
+        const copy_method method = copy_contents (in, out, status, src);
+        if (::fchmod (out, status.st_mode & 07777) != 0) throw copy_error ("Cannot chmod", dst);
+        return method;
+    } catch (...) {
+        ::unlink (dst.c_str());
+        throw;
+    }
+#else
+    fs::copy_file (src, dst);
+    return fs::file_size (dst) > 0 ? copy_method::buffered : copy_method::none;
+#endif
+}
+
 // Move the filesystem item given to the path specified
-void
+copy_method
 move_item_to (const fs::path& item, const fs::path& dst) {
-    if (item_movable (item, dst)) {
-        try {
-            if (fs::is_directory (item)) {
-                create_new_directory_in (fs::canonical (item).filename().string(), dst);
-                move_directory_contents_to (item, dst / fs::path{fs::canonical (item).filename()});
-            }
-            fs::copy (item, dst / fs::canonical (item).filename());
-            fs::remove (item);
-        } catch (std::runtime_error& err) {
-            throw err;
-        }
-    } else throw std::runtime_error{"The item not movable"};
+    if (!item_movable (item, dst)) throw std::runtime_error{"The item not movable"};
+    return move_tree (item, dst / item_name (item));
 }
 
 // Copy the filesystem item given to the path specified
-void
+copy_method
 copy_item_to (const fs::path& item, const fs::path& dst) {
-    if (item_movable (item, dst)) {
-        try {
-            if (fs::is_directory (item)) {
-                create_new_directory_in (fs::canonical (item).filename().string(), dst);
-                copy_directory_contents_to (item, dst / fs::path{fs::canonical (item).filename()});
-            } else {
-                fs::copy (item, dst / fs::canonical (item).filename());
-            }
-        } catch (std::runtime_error& err) {
-            throw err;
-        }
-    } else throw std::runtime_error{"The item not movable"};
+    if (!item_movable (item, dst)) throw std::runtime_error{"The item not movable"};
+    return copy_or_clean_up (item, dst / item_name (item));
 }
 
 // Move all the contents of a directory to the path specified
-void
+copy_method
 move_directory_contents_to (const fs::path& src, const fs::path& dst) {
+    std::vector<fs::path> items;
     for (auto& p : fs::directory_iterator (src)) {
         if (!item_movable (p.path(), dst))
             throw std::runtime_error{"The contents of the directory not moveable"};
+        items.push_back (p.path());
     }
 
-    // All the contents moveable to the destination
-    for (auto& p : fs::directory_iterator (src)) {
-        fs::copy (p.path(), dst / p.path().filename());
-        fs::remove (p.path());
-    }
+    // All the contents moveable to the destination, listed before moving them
+    // so that the iteration does not see the directory change
+    copy_method slowest = copy_method::none;
+    for (const auto& item : items)
+        slowest = std::max (slowest, move_tree (item, dst / item.filename()));
+    return slowest;
 }
 
 // Copy all the contents of a directory to the path specified
-void
+copy_method
 copy_directory_contents_to (const fs::path& src, const fs::path& dst) {
     for (auto& p : fs::directory_iterator (src)) {
         if (!item_movable (p.path(), dst))
@@ -116,9 +345,10 @@ copy_directory_contents_to (const fs::path& src, const fs::path& dst) {
     }
 
     // All the contents moveable to the destination
-    for (auto& p : fs::directory_iterator (src)) {
-        fs::copy (p.path(), dst / p.path().filename());
-    }
+    copy_method slowest = copy_method::none;
+    for (auto& p : fs::directory_iterator (src))
+        slowest = std::max (slowest, copy_or_clean_up (p.path(), dst / p.path().filename()));
+    return slowest;
 }
 
 // Deletes all the contents of a directory
@@ -182,12 +412,12 @@ create_directory (const fs::path& dir) {
  */
 bool
 item_movable (const fs::path& item, const fs::path& dst) {
-    if (!fs::exists (item)) return false;
+    if (!fs::exists (fs::symlink_status (item))) return false;  // A dangling link exists too
 
     if (fs::is_directory (dst)) {        // Destination is directory
         if (fs::exists (dst)) {          // Destination exists
             if (dst.filename() == "") {  // The destination is the inside of the directory
-                if (fs::exists (fs::canonical (dst) / fs::canonical (item).filename()))
+                if (fs::exists (fs::symlink_status (fs::canonical (dst) / item_name (item))))
                     return false;
                 else return true;
             } else {  // The destination is the directory itself.
@@ -212,9 +442,8 @@ item_movable (const fs::path& item, const fs::path& dst) {
  */
 std::string
 to_string (const fs::path& file_path) {
-    if (!fs::exists (file_path)) return std::string{""};
-
-    std::ifstream in (file_path);
+    // Binary mode, so that the size matches the bytes read on every platform
+    std::ifstream in (file_path, std::ios::binary);
     if (in) {
         in.seekg (0, std::ios::end);
         std::size_t len = in.tellg();
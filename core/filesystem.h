@@ -1,3 +1,6 @@
+#ifndef gpw_filesystem_h
+#define gpw_filesystem_h
+
 #include <filesystem>
 #include <string>
 #include <string_view>
@@ -125,25 +128,64 @@ std::string check_duplicate (
  */
 bool directory_exists (const std::string_view&, const fs::path&);
 
+// How the files were moved or copied, from the fastest to the slowest
+enum class copy_method {
+    none,             // Nothing to copy (empty files, directories and links)
+    rename,           // Renamed on the same filesystem, without copying
+    reflink,          // Cloned, sharing the blocks until written (FICLONE)
+    copy_file_range,  // Copied by the kernel, possibly by the filesystem itself
+    sendfile,         // Copied by the kernel through the page cache
+    buffered,         // Read and written through a buffer
+};
+
+// e.g. "copy_file_range"
+std::string_view to_string (copy_method method);
+
+// Copy a regular file
+//
+// Copies the contents and the permissions of src to dst, which must not exist,
+// with the fastest mechanism which the filesystems support: a reflink clone,
+// then copy_file_range, then sendfile, then a buffered copy.  Only the last is
+// available on systems other than Linux.  Returns the mechanism used, or none
+// for an empty file.  Throws runtime_error if the file cannot be copied,
+// having removed dst.
+copy_method copy_regular_file (const fs::path& src, const fs::path& dst);
+
 /**
  * @brief Moves the filesystem item given to the path specified
+ *
+ * An item on the same filesystem as the destination is renamed; otherwise it
+ * is copied as by copy_item_to and removed.  An existing item at the
+ * destination is never replaced: it throws runtime_error.
+ *
+ * @return rename, or the slowest copy_method used for the files
  */
-void move_item_to (const fs::path&, const fs::path&);
+copy_method move_item_to (const fs::path&, const fs::path&);
 
 /**
  * @brief Copies the filesystem item given to the path specified
+ *
+ * The files are copied with copy_regular_file, recursively for a directory,
+ * and symbolic links are copied as links.  If the copy fails, what was copied
+ * is removed.
+ *
+ * @return The slowest copy_method used for the files
  */
-void copy_item_to (const fs::path&, const fs::path&);
+copy_method copy_item_to (const fs::path&, const fs::path&);
 
 /**
  * @brief Moves all the contents of a directory to the path specified
+ *
+ * @return The slowest copy_method used, as for move_item_to
  */
-void move_directory_contents_to (const fs::path&, const fs::path&);
+copy_method move_directory_contents_to (const fs::path&, const fs::path&);
 
 /**
  * @brief Copies all the contents of a directory to the path specified
+ *
+ * @return The slowest copy_method used, as for copy_item_to
  */
-void copy_directory_contents_to (const fs::path&, const fs::path&);
+copy_method copy_directory_contents_to (const fs::path&, const fs::path&);
 
 /**
  * @brief Deletes all the contents of a directory
@@ -183,7 +225,8 @@ bool create_directory (const fs::path& dir);
  */
 bool item_movable (const fs::path& item, const fs::path& dst);
 
-// Read a text file into a string object
+// Read a file into a string object (see mapped_file in core/mapped_file.h to
+// read large files without a copy)
 std::string to_string (const fs::path&);
 
 // Find file
@@ -252,3 +295,5 @@ bool create_directory_symlink (const fs::path target, const fs::path link);
 fs::path follow_target_path (const fs::path& link);
 
 } // namespace gpw::filesystem
+
+#endif
@@ -0,0 +1,276 @@
+#include "core/fuzzy.h"
+#include "core/simd.h"
+
+#include <algorithm>
+
+namespace gpw::str {
+
+namespace {
+
+// Shortest piece worth a filter: shorter ones occur too often in text.
+constexpr std::size_t min_piece_length = 3;
+
+}  // namespace
+
+fuzzy_searcher::fuzzy_searcher (std::string_view pat, std::size_t max_distance, bool ignore_case)
+    : _m{pat.length()}, _k{max_distance}, _count_blocks{(pat.length() + 63) / 64} {
+    _peq.assign (256 * _count_blocks, 0);
+    for (std::size_t i = 0; i < _m; ++i) {
+        const auto          c   = static_cast<unsigned char> (pat[i]);
+        const std::uint64_t bit = std::uint64_t{1} << (i % 64);
+        std::uint64_t*      row = &_peq[256 * (i / 64)];
+        row[c] |= bit;
+        if (ignore_case) {
+            row[gpw::simd::fold_lower (c)] |= bit;
+            row[gpw::simd::fold_upper (c)] |= bit;
+        }
+    }
+
+    if (_k < _m && _m / (_k + 1) >= min_piece_length) {
+        for (std::size_t i = 0; i <= _k; ++i) {
+            const std::size_t begin = i * _m / (_k + 1);
+            const std::size_t end   = (i + 1) * _m / (_k + 1);
+            _pieces.emplace_back (
+                pat.substr (begin, end - begin), searcher::algorithm::automatic, ignore_case
+            );
+            _offsets.push_back (begin);
+        }
+    }
+}
+
+// Scans the bytes [begin, end) of the text as if the text began at begin, and
+// calls on_match (end offset, distance) for the ends from report_from on with
+// at most _k edits, until it returns false.  Returns false if it was stopped.
+// state is scratch space for the vertical deltas of the blocks.
+template <typename F>
+bool
+fuzzy_searcher::_scan (
+    std::string_view            txt,
+    std::size_t                 begin,
+    std::size_t                 end,
+    std::size_t                 report_from,
+    std::vector<std::uint64_t>& state,
+    F&&                         on_match
+) const {
+    const auto* s     = reinterpret_cast<const unsigned char*> (txt.data());
+    std::size_t score = _m;  // Edit distance at the end of the current column
+
+    // Bit of the last pattern position in its block
+    const std::uint64_t last = std::uint64_t{1} << ((_m - 1) % 64);
+
+    if (_count_blocks == 1) {
+        std::uint64_t pv = ~std::uint64_t{0};
+        std::uint64_t mv = 0;
+        for (std::size_t j = begin; j < end; ++j) {
+            const std::uint64_t eq = _peq[s[j]];
+            const std::uint64_t xv = eq | mv;
+            const std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            std::uint64_t       ph = mv | ~(xh | pv);
+            std::uint64_t       mh = pv & xh;
+            score += (ph & last) != 0;
+            score -= (mh & last) != 0;
+
+            // The first row of the matrix is zero, so no delta is shifted in.
+            ph <<= 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+
+            if (score <= _k && j + 1 >= report_from && !on_match (j + 1, score)) return false;
+        }
+        return true;
+    }
+
+    // Positive and negative vertical deltas of each block
+    state.assign (2 * _count_blocks, 0);
+    std::uint64_t* pvs = state.data();
+    std::uint64_t* mvs = state.data() + _count_blocks;
+    std::fill (pvs, pvs + _count_blocks, ~std::uint64_t{0});
+
+    for (std::size_t j = begin; j < end; ++j) {
+        int carry = 0;  // Horizontal delta entering the block
+        for (std::size_t b = 0; b < _count_blocks; ++b) {
+            std::uint64_t       eq = _peq[256 * b + s[j]];
+            const std::uint64_t pv = pvs[b];
+            const std::uint64_t mv = mvs[b];
+            const std::uint64_t xv = eq | mv;
+            if (carry < 0) eq |= 1;
+            const std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            std::uint64_t       ph = mv | ~(xh | pv);
+            std::uint64_t       mh = pv & xh;
+
+            const std::uint64_t top = (b + 1 < _count_blocks) ? std::uint64_t{1} << 63 : last;
+            const int           out = (ph & top) ? 1 : (mh & top) ? -1 : 0;
+
+            ph <<= 1;
+            mh <<= 1;
+            if (carry < 0) mh |= 1;
+            else if (carry > 0) ph |= 1;
+            pvs[b] = mh | ~(xv | ph);
+            mvs[b] = ph & xv;
+            carry  = out;
+        }
+        score += carry;
+
+        if (score <= _k && j + 1 >= report_from && !on_match (j + 1, score)) return false;
+    }
+    return true;
+}
+
+// Scans count_lanes stripes of the text [start + l * length, start + (l + 1) *
+// length) at once, with independent states, so that the latency of the serial
+// dependencies of the bit-parallel update is hidden.  Each stripe is preceded
+// by a warm up of width bytes, which must be in the text.  Single block only.
+void
+fuzzy_searcher::_scan_lanes (
+    std::string_view                             txt,
+    std::size_t                                  start,
+    std::size_t                                  length,
+    std::size_t                                  width,
+    std::array<std::vector<match>, count_lanes>& found
+) const {
+    const auto*          s    = reinterpret_cast<const unsigned char*> (txt.data());
+    const std::uint64_t* peq  = _peq.data();
+    const std::size_t    k    = _k;
+    const std::uint64_t  last = std::uint64_t{1} << (_m - 1);
+
+    std::uint64_t pv[count_lanes], mv[count_lanes];
+    std::size_t   score[count_lanes];
+    for (std::size_t l = 0; l < count_lanes; ++l) {
+        pv[l]    = ~std::uint64_t{0};
+        mv[l]    = 0;
+        score[l] = _m;
+        found[l].clear();
+    }
+
+    const std::size_t begin = start - width;
+    for (std::size_t step = 0; step < width + length; ++step) {
+        for (std::size_t l = 0; l < count_lanes; ++l) {
+            const std::size_t   j  = begin + l * length + step;
+            const std::uint64_t eq = peq[s[j]];
+            const std::uint64_t xv = eq | mv[l];
+            const std::uint64_t xh = (((eq & pv[l]) + pv[l]) ^ pv[l]) | eq;
+            std::uint64_t       ph = mv[l] | ~(xh | pv[l]);
+            std::uint64_t       mh = pv[l] & xh;
+            score[l] += (ph & last) != 0;
+            score[l] -= (mh & last) != 0;
+            ph <<= 1;
+            mh <<= 1;
+            pv[l] = mh | ~(xv | ph);
+            mv[l] = ph & xv;
+
+            if (score[l] <= k && step >= width) found[l].push_back ({j + 1, score[l]});
+        }
+    }
+}
+
+template <typename F>
+void
+fuzzy_searcher::_for_each (std::string_view txt, F&& on_match) const {
+    const std::size_t n = txt.length();
+    if (_m == 0) {
+        for (std::size_t j = 1; j <= n; ++j)
+            if (!on_match (j, 0)) return;
+        return;
+    }
+
+    std::vector<std::uint64_t> state;
+    if (_pieces.empty()) {
+        // Ends up to done are reported.  The stripes of _scan_lanes need a warm
+        // up of the longest match.
+        const std::size_t width = _m + _k;
+        std::size_t       done  = 0;
+        if (_count_blocks == 1 && n >= width + count_lanes * lane_length) {
+            if (!_scan (txt, 0, width, 0, state, on_match)) return;
+            done = width;
+
+            std::array<std::vector<match>, count_lanes> found;
+            while (n - done >= count_lanes * lane_length) {
+                _scan_lanes (txt, done, lane_length, width, found);
+                for (const auto& lane : found)
+                    for (const auto& m : lane)
+                        if (!on_match (m.end, m.distance)) return;
+                done += count_lanes * lane_length;
+            }
+        }
+        _scan (txt, (done > width) ? done - width : 0, n, done + 1, state, on_match);
+        return;
+    }
+
+    // The occurrences of the pieces, merged in the order of the match ends
+    // they imply: a match aligning piece i with zero edits at p ends in
+    // [p - offset + m - k, p - offset + m + k].  Overlapping ranges of ends
+    // are merged and each group is scanned from far enough back to see all
+    // the matches ending in it.
+    std::vector<std::size_t> next (_pieces.size());
+    for (std::size_t i = 0; i < _pieces.size(); ++i)
+        next[i] = _pieces[i].find_first (txt);
+
+    std::size_t group_lo = std::string_view::npos;
+    std::size_t group_hi = 0;
+    auto        flush    = [&] {
+        if (group_lo == std::string_view::npos) return true;
+        const std::size_t begin = (group_lo > _m + _k) ? group_lo - _m - _k : 0;
+        return _scan (txt, begin, group_hi, group_lo, state, on_match);
+    };
+
+    for (;;) {
+        std::size_t best     = 0;
+        std::size_t best_end = std::string_view::npos;  // p - offset + m
+        for (std::size_t i = 0; i < next.size(); ++i) {
+            if (next[i] == std::string_view::npos) continue;
+            const std::size_t implied = next[i] + _m - _offsets[i];
+            if (implied < best_end) {
+                best     = i;
+                best_end = implied;
+            }
+        }
+        if (best_end == std::string_view::npos) break;
+        next[best] = _pieces[best].find_first (txt, next[best] + 1);
+
+        const std::size_t lo = (best_end > _k) ? best_end - _k : 1;
+        const std::size_t hi = std::min (best_end + _k, n);
+        if (lo > hi) continue;
+
+        if (group_lo != std::string_view::npos && lo <= group_hi + 1) {
+            group_hi = std::max (group_hi, hi);
+        } else {
+            if (!flush()) return;
+            group_lo = lo;
+            group_hi = hi;
+        }
+    }
+    flush();
+}
+
+std::size_t
+fuzzy_searcher::find_all (std::string_view txt, std::vector<match>& out) const {
+    out.clear();
+    _for_each (txt, [&out] (std::size_t end, std::size_t distance) {
+        out.push_back ({end, distance});
+        return true;
+    });
+    return out.size();
+}
+
+std::size_t
+fuzzy_searcher::count (std::string_view txt) const {
+    std::size_t count = 0;
+    _for_each (txt, [&count] (std::size_t, std::size_t) {
+        ++count;
+        return true;
+    });
+    return count;
+}
+
+bool
+fuzzy_searcher::contains (std::string_view txt) const {
+    bool found = false;
+    _for_each (txt, [&found] (std::size_t, std::size_t) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+}  // namespace gpw::str
@@ -0,0 +1,108 @@
+// -----------------------------------------------------------------------------
+// Approximate string search
+// -----------------------------------------------------------------------------
+#ifndef gpw_fuzzy_h
+#define gpw_fuzzy_h
+
+#include "core/search.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gpw::str {
+
+// Precompiled approximate searcher
+//
+// Finds the places where a pattern occurs in a text with at most max_distance
+// edits (insertions, deletions or substitutions of a byte), e.g. "recieve"
+// matches "receive" with 2 edits.  The matches are reported by their end
+// offsets: a match ending at end has the smallest edit distance of the
+// pattern to a substring of the text ending there.
+//
+// The text is scanned with Myers' bit-parallel algorithm, which updates a
+// column of the dynamic programming matrix for 64 pattern positions per
+// machine word (Hyyro's blocks for longer patterns).  Unless the pieces are
+// too short, the pattern is also split into max_distance + 1 pieces, of which
+// at least one occurs exactly in every match, so the vectorized exact
+// searchers of the pieces find the candidate regions and only these are
+// scanned.
+//
+//   fuzzy_searcher fs{"timeout", 1};
+//   if (fs.contains (line)) ...
+class fuzzy_searcher {
+  public:
+    struct match {
+        std::size_t end;       // Offset past the last byte of the match
+        std::size_t distance;  // Number of edits
+
+        bool
+        operator== (const match& other) const {
+            return end == other.end && distance == other.distance;
+        }
+    };
+
+    fuzzy_searcher (std::string_view pat, std::size_t max_distance, bool ignore_case = false);
+
+    // Stores all the end offsets with a match in increasing order in out,
+    // replacing its contents but reusing its capacity.  Returns the count.
+    std::size_t
+    find_all (std::string_view txt, std::vector<match>& out) const;
+
+    std::size_t
+    count (std::string_view txt) const;
+
+    bool
+    contains (std::string_view txt) const;
+
+    std::size_t
+    max_distance () const {
+        return _k;
+    }
+
+  private:
+    template <typename F>
+    void
+    _for_each (std::string_view txt, F&& on_match) const;
+
+    template <typename F>
+    bool
+    _scan (
+        std::string_view            txt,
+        std::size_t                 begin,
+        std::size_t                 end,
+        std::size_t                 report_from,
+        std::vector<std::uint64_t>& state,
+        F&&                         on_match
+    ) const;
+
+    static constexpr std::size_t count_lanes = 4;
+    static constexpr std::size_t lane_length = 4096;
+
+    void
+    _scan_lanes (
+        std::string_view                             txt,
+        std::size_t                                  start,
+        std::size_t                                  length,
+        std::size_t                                  width,
+        std::array<std::vector<match>, count_lanes>& found
+    ) const;
+
+    std::size_t _m;
+    std::size_t _k;
+    std::size_t _count_blocks;
+
+    // Bit i of the entry of byte c in block b: pattern[64 * b + i] matches c
+    std::vector<std::uint64_t> _peq;
+
+    // Filter: exact searchers of the pieces and their offsets in the pattern
+    std::vector<searcher>    _pieces;
+    std::vector<std::size_t> _offsets;
+};
+
+}  // namespace gpw::str
+
+#endif
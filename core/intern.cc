@@ -0,0 +1,116 @@
+#include "core/intern.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+namespace gpw::str {
+
+intern_table::intern_table (unsigned concurrency) : _shard_bits{0} {
+    while (_shard_bits < max_shard_bits && (1u << _shard_bits) < 4 * std::max (concurrency, 1u))
+        ++_shard_bits;
+    _shards.reset (new shard[std::size_t{1} << _shard_bits]);
+}
+
+std::int64_t
+intern_table::shard::find (std::string_view str, std::uint64_t hash) const {
+    if (slots.empty()) return -1;
+
+    const std::size_t mask = slots.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+        const slot& s = slots[i];
+        if (s.index == 0) return -1;
+        if (s.hash == hash && strings[s.index - 1] == str) return s.index - 1;
+    }
+}
+
+intern_table::id_type
+intern_table::shard::insert (std::string_view str, std::uint64_t hash, std::size_t max_strings) {
+    if (strings.size() + 1 >= max_strings)
+        throw std::runtime_error{"intern table is full"};
+
+    // Keep the load factor at most 1/2.
+    if (2 * (strings.size() + 1) > slots.size()) {
+        std::vector<slot> old (std::max<std::size_t> (16, 2 * slots.size()));
+        old.swap (slots);
+        const std::size_t mask = slots.size() - 1;
+        for (const slot& s : old) {
+            if (s.index == 0) continue;
+            std::size_t i = s.hash & mask;
+            while (slots[i].index != 0)
+                i = (i + 1) & mask;
+            slots[i] = s;
+        }
+    }
+
+    // Every string gets its own bytes, so the views of distinct strings never
+    // compare equal by data pointer, even when empty.
+    char* data = static_cast<char*> (bytes.allocate (std::max<std::size_t> (str.length(), 1), 1));
+    std::memcpy (data, str.data(), str.length());
+    strings.emplace_back (data, str.length());
+
+    const auto        index = static_cast<id_type> (strings.size());
+    const std::size_t mask  = slots.size() - 1;
+    std::size_t       i     = hash & mask;
+    while (slots[i].index != 0)
+        i = (i + 1) & mask;
+    slots[i] = {hash, index};
+    return index - 1;
+}
+
+std::pair<intern_table::id_type, std::string_view>
+intern_table::_intern (std::string_view str) {
+    const std::uint64_t hash = std::hash<std::string_view>{}(str);
+    const std::size_t   k    = (hash >> (64 - max_shard_bits)) & ((1u << _shard_bits) - 1);
+    shard&              sh   = _shards[k];
+
+    // Ids hold the shard in their low bits and the index in the shard above.
+    auto to_id = [this, k] (std::uint64_t index) {
+        return static_cast<id_type> ((index << _shard_bits) | k);
+    };
+
+    {
+        std::shared_lock<std::shared_mutex> lock (sh.mutex);
+        const auto                          index = sh.find (str, hash);
+        if (index >= 0) return {to_id (index), sh.strings[index]};
+    }
+
+    std::unique_lock<std::shared_mutex> lock (sh.mutex);
+    auto                                index = sh.find (str, hash);
+    if (index < 0) index = sh.insert (str, hash, std::size_t{1} << (32 - _shard_bits));
+    return {to_id (index), sh.strings[index]};
+}
+
+intern_table::id_type
+intern_table::id (std::string_view str) {
+    return _intern (str).first;
+}
+
+std::string_view
+intern_table::intern (std::string_view str) {
+    return _intern (str).second;
+}
+
+std::string_view
+intern_table::str (id_type id) const {
+    const shard&      sh    = _shards[id & ((1u << _shard_bits) - 1)];
+    const std::size_t index = id >> _shard_bits;
+
+    std::shared_lock<std::shared_mutex> lock (sh.mutex);
+    if (index >= sh.strings.size()) throw std::runtime_error{"unknown intern id"};
+    return sh.strings[index];
+}
+
+std::size_t
+intern_table::size () const {
+    std::size_t count = 0;
+    for (std::size_t k = 0; k < (std::size_t{1} << _shard_bits); ++k) {
+        std::shared_lock<std::shared_mutex> lock (_shards[k].mutex);
+        count += _shards[k].strings.size();
+    }
+    return count;
+}
+
+}  // namespace gpw::str
@@ -0,0 +1,97 @@
+// -----------------------------------------------------------------------------
+// String interning
+// -----------------------------------------------------------------------------
+#ifndef gpw_intern_h
+#define gpw_intern_h
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace gpw::str {
+
+// Concurrent string interning table
+//
+// Stores each distinct string once and identifies it by a stable id and a
+// stable view: interning equal strings yields the same id and a view of the
+// same bytes, so interned strings can be compared by id (or data pointer).
+// The strings are immutable and live as long as the table.
+//
+// The table is split into shards selected by the hash of the string, each
+// with its own lock, open addressing index and monotonic buffer for the bytes,
+// so that threads interning different strings rarely contend.  Looking up a
+// string which is already interned takes a shared lock only.  The number of
+// shards follows the expected concurrency (4 per thread, up to 64), so that a
+// table used by few threads stays small until strings are interned.
+//
+//   intern_table table;
+//   const auto id = table.id (message);
+//   ...
+//   std::cout << table.str (id);
+class intern_table {
+  public:
+    using id_type = std::uint32_t;
+
+    // concurrency is the number of threads expected to intern at a time.
+    explicit intern_table (unsigned concurrency = std::thread::hardware_concurrency());
+
+    intern_table (const intern_table&)            = delete;
+    intern_table& operator= (const intern_table&) = delete;
+
+    // Interns str and returns its id.  Throws runtime_error if the table is
+    // full (about 2^32 strings).
+    id_type
+    id (std::string_view str);
+
+    // Interns str and returns the stored copy.
+    std::string_view
+    intern (std::string_view str);
+
+    // The string with the given id.  Throws runtime_error for an unknown id.
+    std::string_view
+    str (id_type id) const;
+
+    // Number of distinct strings
+    std::size_t
+    size () const;
+
+  private:
+    static constexpr int max_shard_bits = 6;
+
+    struct alignas (64) shard {
+        struct slot {
+            std::uint64_t hash  = 0;
+            id_type       index = 0;  // Index in strings + 1, 0 if empty
+        };
+
+        mutable std::shared_mutex           mutex;
+        std::vector<slot>                   slots;
+        std::vector<std::string_view>       strings;
+        std::pmr::monotonic_buffer_resource bytes{std::pmr::new_delete_resource()};
+
+        // Index of the string in strings, or -1
+        std::int64_t
+        find (std::string_view str, std::uint64_t hash) const;
+
+        // max_strings is the limit of the shard for the ids to fit id_type.
+        id_type
+        insert (std::string_view str, std::uint64_t hash, std::size_t max_strings);
+    };
+
+    // Id and view of an interned string
+    std::pair<id_type, std::string_view>
+    _intern (std::string_view str);
+
+    int                      _shard_bits;
+    std::unique_ptr<shard[]> _shards;
+};
+
+}  // namespace gpw::str
+
+#endif
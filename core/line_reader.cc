@@ -0,0 +1,174 @@
+#include "core/line_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+namespace gpw::filesystem {
+
+void
+line_reader::block_deleter::operator() (char* block) const {
+    ::operator delete (block, std::align_val_t{block_alignment});
+}
+
+line_reader::line_reader (
+    const std::filesystem::path& path, char delimiter, std::size_t block_size, bool read_ahead
+)
+    : _file{std::fopen (path.string().c_str(), "rb")}, _delimiter{delimiter},
+      _block_size{std::max<std::size_t> (block_size, 1)}, _read_ahead_enabled{read_ahead} {
+    if (!_file) throw std::runtime_error{"cannot open the file: " + path.string()};
+
+    // The blocks are large, so stdio's buffer would only add a copy.
+    std::setvbuf (_file.get(), nullptr, _IONBF, 0);
+#if defined(__linux__)
+    ::posix_fadvise (fileno (_file.get()), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    for (std::size_t i = 0; i < (read_ahead ? count_blocks : 1); ++i) {
+        _blocks.emplace_back (
+            static_cast<char*> (::operator new (_block_size, std::align_val_t{block_alignment}))
+        );
+    }
+    if (read_ahead) {
+        for (std::size_t i = 0; i < count_blocks; ++i)
+            _free.push_back (static_cast<int> (i));
+        _reader = std::thread{&line_reader::_read_ahead, this};
+    }
+}
+
+line_reader::~line_reader () {
+    {
+        std::lock_guard lock{_mutex};
+        _stop = true;
+    }
+    _changed.notify_all();
+    if (_reader.joinable()) _reader.join();
+}
+
+bool
+line_reader::next (std::string_view& record) {
+    for (;;) {
+        if (_pos < _end) {
+            const char*       start     = _data + _pos;
+            const std::size_t available = _end - _pos;
+            const auto*       found =
+                static_cast<const char*> (std::memchr (start, _delimiter, available));
+            if (found != nullptr) {
+                const auto length = static_cast<std::size_t> (found - start);
+                _pos += length + 1;
+                ++_count;
+                if (_carrying) {
+                    _carry.append (start, length);
+                    _carrying = false;
+                    record    = _finish (_carry);
+                } else {
+                    record = _finish ({start, length});
+                }
+                return true;
+            }
+
+            // The record continues in the next block.
+            if (!_carrying) {
+                _carry.clear();
+                _carrying = true;
+            }
+            _carry.append (start, available);
+            _pos = _end;
+        }
+
+        if (_done) return false;
+        if (!_next_block()) {
+            _done = true;
+            if (!_carrying) return false;
+            _carrying = false;
+            ++_count;
+            record = _finish (_carry);
+            return true;
+        }
+    }
+}
+
+std::string_view
+line_reader::_finish (std::string_view record) const {
+    if (_delimiter == '\n' && !record.empty() && record.back() == '\r') record.remove_suffix (1);
+    return record;
+}
+
+std::size_t
+line_reader::_read (char* block) {
+    std::size_t size = 0;
+    while (size < _block_size) {
+        const std::size_t count = std::fread (block + size, 1, _block_size - size, _file.get());
+        if (count == 0) {
+            if (std::ferror (_file.get())) throw std::runtime_error{"cannot read the file"};
+            break;
+        }
+        size += count;
+    }
+    return size;
+}
+
+bool
+line_reader::_next_block () {
+    if (!_read_ahead_enabled) {
+        _current = 0;
+        _data    = _blocks[0].get();
+        _pos     = 0;
+        _end     = _read (_blocks[0].get());
+        return _end > 0;
+    }
+
+    std::unique_lock lock{_mutex};
+    if (_current >= 0) {
+        _free.push_back (_current);
+        _current = -1;
+        _changed.notify_all();
+    }
+    _changed.wait (lock, [this] { return !_ready.empty() || _error; });
+    if (_ready.empty()) std::rethrow_exception (_error);
+
+    const auto [index, size] = _ready.front();
+    _ready.pop_front();
+    _current = index;
+    _data    = _blocks[index].get();
+    _pos     = 0;
+    _end     = size;
+    return size > 0;
+}
+
+void
+line_reader::_read_ahead () {
+    try {
+        for (;;) {
+            int index;
+            {
+                std::unique_lock lock{_mutex};
+                _changed.wait (lock, [this] { return _stop || !_free.empty(); });
+                if (_stop) return;
+                index = _free.front();
+                _free.pop_front();
+            }
+
+            const std::size_t size = _read (_blocks[index].get());
+            {
+                std::lock_guard lock{_mutex};
+                _ready.emplace_back (index, size);
+            }
+            _changed.notify_all();
+            if (size == 0) return;
+        }
+    } catch (...) {
+        {
+            std::lock_guard lock{_mutex};
+            _error = std::current_exception();
+        }
+        _changed.notify_all();
+    }
+}
+
+}  // namespace gpw::filesystem
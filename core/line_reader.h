@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+// Streaming line reader
+// -----------------------------------------------------------------------------
+#ifndef gpw_line_reader_h
+#define gpw_line_reader_h
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace gpw::filesystem {
+
+// Reads a file record by record in constant memory
+//
+// The file is read in large page aligned blocks, and the records (lines by
+// default) are found in them with memchr and returned as views of the block,
+// so that no record is allocated; only a record which crosses the end of a
+// block is copied, into a buffer reused for the next ones.  The delimiter is
+// not part of the records, nor is the '\r' of a "\r\n" line ending, and the
+// last record needs no delimiter.
+//
+// With read_ahead, a background thread reads the next blocks while the current
+// one is processed, so that the processing overlaps the I/O.
+//
+//   line_reader reader{path};
+//   std::string_view line;
+//   while (reader.next (line))
+//       process (line);
+//
+// Throws runtime_error if the file cannot be opened, and from next() if it
+// cannot be read.
+class line_reader {
+  public:
+    static constexpr std::size_t default_block_size = std::size_t{1} << 20;
+
+    explicit line_reader (
+        const std::filesystem::path& path,
+        char                         delimiter  = '\n',
+        std::size_t                  block_size = default_block_size,
+        bool                         read_ahead = true
+    );
+
+    line_reader (const line_reader&)            = delete;
+    line_reader& operator= (const line_reader&) = delete;
+
+    ~line_reader ();
+
+    // Stores the next record in record, valid until the next call.  Returns
+    // false at the end of the file.
+    bool
+    next (std::string_view& record);
+
+    // Number of records returned so far
+    std::size_t
+    count () const {
+        return _count;
+    }
+
+  private:
+    static constexpr std::size_t count_blocks    = 3;
+    static constexpr std::size_t block_alignment = 4096;
+
+    struct block_deleter {
+        void
+        operator() (char* block) const;
+    };
+
+    struct file_closer {
+        void
+        operator() (std::FILE* file) const {
+            std::fclose (file);
+        }
+    };
+
+    using block_ptr = std::unique_ptr<char, block_deleter>;
+
+    // Makes the next block current.  Returns false at the end of the file.
+    bool
+    _next_block ();
+
+    // Reads up to _block_size bytes into a block; returns the count.
+    std::size_t
+    _read (char* block);
+
+    void
+    _read_ahead ();
+
+    std::string_view
+    _finish (std::string_view record) const;
+
+    std::unique_ptr<std::FILE, file_closer> _file;
+    const char                              _delimiter;
+    const std::size_t                       _block_size;
+    std::vector<block_ptr>                  _blocks;
+
+    // The current block, its bytes [_pos, _end) not returned yet
+    int         _current = -1;
+    const char* _data    = nullptr;
+    std::size_t _pos     = 0;
+    std::size_t _end     = 0;
+
+    std::string _carry;  // Record crossing blocks
+    bool        _carrying = false;
+    bool        _done     = false;
+    std::size_t _count    = 0;
+
+    // Read ahead: the producer fills the free blocks and queues them as ready
+    // with their sizes, a size of 0 marking the end of the file.
+    bool                                    _read_ahead_enabled;
+    std::mutex                              _mutex;
+    std::condition_variable                 _changed;
+    std::deque<int>                         _free;
+    std::deque<std::pair<int, std::size_t>> _ready;
+    std::exception_ptr                      _error;
+    bool                                    _stop = false;
+    std::thread                             _reader;
+};
+
+}  // namespace gpw::filesystem
+
+#endif
@@ -14,7 +14,8 @@ void
 logger_t::_log (const size_t idx, const std::string_view msg) {
     std::string log_msg =
         std::string{"["} + std::string{_prefixes[idx]} + std::string{"] "} + std::string{msg};
-    _logs.emplace_back (msg);
+    if (!_strings) _strings = std::make_shared<gpw::str::intern_table>();
+    _logs.push_back (_strings->id (msg));
 
     if (_console_output_enabled) {
         std::cout << log_msg << '\n';
@@ -44,13 +45,16 @@ logger_t::write (const fs::path& path, const bool flush) {
 
     std::ofstream strm{path};
     if (strm.is_open()) {
-        for (const auto& log : _logs) {
-            strm << log << '\n';
+        for (const auto id : _logs) {
+            strm << _strings->str (id) << '\n';
         }
         done = true;
     }
 
-    if (flush && done) _logs.clear();
+    if (flush && done) {
+        _logs.clear();
+        _strings.reset();
+    }
 }
 
 }  // namespace gpw::utils
@@ -1,6 +1,8 @@
+#include "core/intern.h"
 #include "core/str.h"
 
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -41,8 +43,12 @@ class logger_t {
     void
     _log (const size_t, const std::string_view);
 
-    bool                     _console_output_enabled = true;
-    std::vector<std::string> _logs;
+    bool _console_output_enabled = true;
+
+    // The messages are interned, so repeated ones are stored once.  Copies of
+    // a logger share the table until they are flushed.
+    std::shared_ptr<gpw::str::intern_table>      _strings;
+    std::vector<gpw::str::intern_table::id_type> _logs;
     std::vector<std::string> _prefixes = {" ", "\033[1;33m*\033[0m", "\033[1;31m!\033[0m"};
 };
 
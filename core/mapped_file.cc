@@ -0,0 +1,171 @@
+#include "core/mapped_file.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GPW_HAS_MMAP 1
+#endif
+
+namespace gpw::filesystem {
+
+namespace {
+
+#if defined(GPW_HAS_MMAP)
+// Closes a file descriptor at the end of the scope
+struct fd_guard {
+    int fd;
+
+    ~fd_guard () {
+        ::close (fd);
+    }
+};
+
+// Reads from fd until the end of the file, starting with a buffer of
+// size_hint + 1 bytes so that a file of the expected size takes one read()
+// plus one to see the end.
+std::unique_ptr<char[]>
+read_all (int fd, std::size_t size_hint, std::size_t& size) {
+    std::size_t             capacity = size_hint + 1;
+    std::unique_ptr<char[]> buffer{new char[capacity]};
+    size = 0;
+    for (;;) {
+        if (size == capacity) {
+            std::unique_ptr<char[]> larger{new char[capacity * 2]};
+            std::copy (buffer.get(), buffer.get() + size, larger.get());
+            buffer = std::move (larger);
+            capacity *= 2;
+        }
+        const ssize_t count = ::read (fd, buffer.get() + size, capacity - size);
+        if (count == 0) return buffer;
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error{"cannot read the file"};
+        }
+        size += static_cast<std::size_t> (count);
+    }
+}
+
+int
+to_madvise (unsigned hints) {
+    switch (hints) {
+    case mapped_file::sequential: return MADV_SEQUENTIAL;
+    case mapped_file::random: return MADV_RANDOM;
+    case mapped_file::will_need: return MADV_WILLNEED;
+    case mapped_file::dont_need: return MADV_DONTNEED;
+#if defined(MADV_HUGEPAGE)
+    case mapped_file::huge_pages: return MADV_HUGEPAGE;
+#endif
+    default: return -1;
+    }
+}
+#endif
+
+}  // namespace
+
+mapped_file::mapped_file (
+    const std::filesystem::path& path, unsigned hints, std::size_t min_map_size
+) {
+#if defined(GPW_HAS_MMAP)
+    const int fd = ::open (path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error{"cannot open the file: " + path.string()};
+    const fd_guard guard{fd};
+
+    struct stat st;
+    if (::fstat (fd, &st) != 0) throw std::runtime_error{"cannot stat the file: " + path.string()};
+    const auto size = static_cast<std::size_t> (st.st_size);
+
+    if (S_ISREG (st.st_mode) && size > 0 && size >= min_map_size) {
+        void* address = ::mmap (nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            _data   = static_cast<const char*> (address);
+            _size   = size;
+            _mapped = true;
+            advise (hints);
+            return;
+        }
+    }
+
+    _buffer = read_all (fd, S_ISREG (st.st_mode) ? size : 0, _size);
+    _data   = _buffer.get();
+#else
+    std::ifstream in (path, std::ios::binary);
+    if (!in) throw std::runtime_error{"cannot open the file: " + path.string()};
+    std::string contents{std::istreambuf_iterator<char> (in), {}};
+    _size   = contents.size();
+    _buffer.reset (new char[_size + 1]);
+    std::copy (contents.begin(), contents.end(), _buffer.get());
+    _data = _buffer.get();
+    static_cast<void> (hints);
+    static_cast<void> (min_map_size);
+#endif
+}
+
+mapped_file::mapped_file (mapped_file&& other) noexcept
+    : _data{std::exchange (other._data, nullptr)}, _size{std::exchange (other._size, 0)},
+      _mapped{std::exchange (other._mapped, false)}, _buffer{std::move (other._buffer)} {}
+
+mapped_file&
+mapped_file::operator= (mapped_file&& other) noexcept {
+    if (this != &other) {
+        close();
+        _data   = std::exchange (other._data, nullptr);
+        _size   = std::exchange (other._size, 0);
+        _mapped = std::exchange (other._mapped, false);
+        _buffer = std::move (other._buffer);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file () {
+    close();
+}
+
+bool
+mapped_file::advise (unsigned hints, std::size_t offset, std::size_t length) {
+#if defined(GPW_HAS_MMAP)
+    if (!_mapped || offset >= _size) return true;
+    length = std::min (length, _size - offset);
+
+    // madvise requires a page aligned start.
+    const auto        page  = static_cast<std::size_t> (::sysconf (_SC_PAGESIZE));
+    const std::size_t start = offset / page * page;
+    char*             addr  = const_cast<char*> (_data) + start;
+    length += offset - start;
+
+    bool accepted = true;
+    for (unsigned hint = 1; hint <= hints; hint <<= 1) {
+        if ((hints & hint) == 0) continue;
+        const int advice = to_madvise (hint);
+        if (advice >= 0) accepted &= ::madvise (addr, length, advice) == 0;
+    }
+    return accepted;
+#else
+    static_cast<void> (hints);
+    static_cast<void> (offset);
+    static_cast<void> (length);
+    return true;
+#endif
+}
+
+void
+mapped_file::close () {
+#if defined(GPW_HAS_MMAP)
+    if (_mapped) ::munmap (const_cast<char*> (_data), _size);
+#endif
+    _buffer.reset();
+    _data   = nullptr;
+    _size   = 0;
+    _mapped = false;
+}
+
+}  // namespace gpw::filesystem
@@ -0,0 +1,105 @@
+// -----------------------------------------------------------------------------
+// Memory mapped files
+// -----------------------------------------------------------------------------
+#ifndef gpw_mapped_file_h
+#define gpw_mapped_file_h
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+namespace gpw::filesystem {
+
+// Read only view of the contents of a file
+//
+// Large regular files are mapped into memory, so that their pages are shared
+// with the page cache instead of being copied into a buffer, and are loaded on
+// demand.  Files smaller than min_map_size, and those which cannot be mapped
+// (pipes, or files of special filesystems like /proc which report a size of
+// 0), are read into a buffer instead.  Either way the contents are exposed as
+// a string_view, valid as long as the mapped_file.
+//
+//   const mapped_file file{path, mapped_file::sequential | mapped_file::will_need};
+//   for (const auto line : gpw::str::split (file.view(), '\n')) ...
+//
+// Throws runtime_error if the file cannot be opened or read.  If the file is
+// truncated by another process while it is mapped, accessing the missing pages
+// raises SIGBUS.
+class mapped_file {
+  public:
+    // Hints to the kernel on the access to the pages (madvise), ignored for
+    // buffered files and where unsupported
+    enum advice : unsigned {
+        normal     = 0,
+        sequential = 1,   // Read ahead aggressively and drop pages behind
+        random     = 2,   // Do not read ahead
+        will_need  = 4,   // Start reading the whole file in the background
+        huge_pages = 8,   // Back the mapping with transparent huge pages
+        dont_need  = 16,  // Drop the pages from the mapping (e.g. once processed)
+    };
+
+    static constexpr std::size_t default_min_map_size = 64 * 1024;
+
+    mapped_file () = default;
+
+    explicit mapped_file (
+        const std::filesystem::path& path,
+        unsigned                     hints        = sequential,
+        std::size_t                  min_map_size = default_min_map_size
+    );
+
+    mapped_file (mapped_file&& other) noexcept;
+    mapped_file& operator= (mapped_file&& other) noexcept;
+
+    mapped_file (const mapped_file&)            = delete;
+    mapped_file& operator= (const mapped_file&) = delete;
+
+    ~mapped_file ();
+
+    std::string_view
+    view () const {
+        return {_data, _size};
+    }
+
+    const std::byte*
+    bytes () const {
+        return reinterpret_cast<const std::byte*> (_data);
+    }
+
+    std::size_t
+    size () const {
+        return _size;
+    }
+
+    bool
+    empty () const {
+        return _size == 0;
+    }
+
+    // True if the contents are mapped rather than buffered
+    bool
+    is_mapped () const {
+        return _mapped;
+    }
+
+    // Gives hints for the bytes [offset, offset + length), e.g. that a
+    // processed range will not be needed again.  Returns false if the kernel
+    // rejected them.
+    bool
+    advise (unsigned hints, std::size_t offset = 0, std::size_t length = std::string_view::npos);
+
+    // Unmaps or frees the contents; the view becomes empty.
+    void
+    close ();
+
+  private:
+    const char*             _data   = nullptr;
+    std::size_t             _size   = 0;
+    bool                    _mapped = false;
+    std::unique_ptr<char[]> _buffer;
+};
+
+}  // namespace gpw::filesystem
+
+#endif
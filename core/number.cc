@@ -0,0 +1,46 @@
+#include "core/number.h"
+
+#include <algorithm>
+
+namespace gpw::str {
+
+parse_result<double>
+parse_double (std::string_view str) {
+    if (!str.empty() && str.front() == '+') {
+        str.remove_prefix (1);
+        if (!str.empty() && str.front() == '-') return {0.0, std::errc::invalid_argument};
+    }
+
+    parse_result<double> result;
+    const char*          end    = str.data() + str.length();
+    const auto           parsed = std::from_chars (str.data(), end, result.value);
+    result.error                = (parsed.ec == std::errc{} && parsed.ptr != end)
+                                      ? std::errc::invalid_argument
+                                      : parsed.ec;
+    return result;
+}
+
+std::size_t
+parse_double (const std::vector<std::string_view>& fields, std::vector<double>& out) {
+    std::size_t first_error = std::string_view::npos;
+    out.resize (fields.size());
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        const auto result = parse_double (fields[i]);
+        out[i]            = result ? result.value : 0.0;
+        if (!result) first_error = std::min (first_error, i);
+    }
+    return first_error;
+}
+
+char*
+format_double (double value, char* dst) {
+    return std::to_chars (dst, dst + 32, value).ptr;
+}
+
+std::string
+format_double (double value) {
+    char buf[32];
+    return std::string (buf, format_double (value, buf));
+}
+
+}  // namespace gpw::str
@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+// Number parsing and formatting
+// -----------------------------------------------------------------------------
+#ifndef gpw_number_h
+#define gpw_number_h
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace gpw::str {
+
+// The conversions are built on std::from_chars and std::to_chars: they do not
+// allocate, do not depend on the locale, and report errors instead of
+// throwing.
+
+// Result of a conversion.  error is std::errc{} on success, invalid_argument
+// if the string is not a number (leading or trailing characters included) and
+// result_out_of_range if the number does not fit the type.
+template <typename T>
+struct parse_result {
+    T         value{};
+    std::errc error{};
+
+    explicit operator bool () const {
+        return error == std::errc{};
+    }
+};
+
+// Parses an integer with an optional sign, in the given base (2 to 36).
+template <typename T = long long>
+parse_result<T>
+parse_int (std::string_view str, int base = 10) {
+    static_assert (std::is_integral_v<T>, "parse_int requires an integral type");
+
+    if (!str.empty() && str.front() == '+') {
+        str.remove_prefix (1);
+        if (!str.empty() && str.front() == '-') return {T{}, std::errc::invalid_argument};
+    }
+
+    parse_result<T> result;
+    const char*     end    = str.data() + str.length();
+    const auto      parsed = std::from_chars (str.data(), end, result.value, base);
+    result.error           = (parsed.ec == std::errc{} && parsed.ptr != end)
+                                 ? std::errc::invalid_argument
+                                 : parsed.ec;
+    return result;
+}
+
+// Parses a floating point number in fixed or scientific notation, with an
+// optional sign, or inf or nan.
+parse_result<double>
+parse_double (std::string_view str);
+
+// Parses a column of fields into out (resized to the number of fields).
+// Fields which are not numbers get the value 0.  Returns the index of the
+// first of them, or npos if all the fields were parsed.
+template <typename T = long long>
+std::size_t
+parse_int (const std::vector<std::string_view>& fields, std::vector<T>& out, int base = 10) {
+    std::size_t first_error = std::string_view::npos;
+    out.resize (fields.size());
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        const auto result = parse_int<T> (fields[i], base);
+        out[i]            = result ? result.value : T{};
+        if (!result) first_error = std::min (first_error, i);
+    }
+    return first_error;
+}
+
+std::size_t
+parse_double (const std::vector<std::string_view>& fields, std::vector<double>& out);
+
+// Maximum length of a formatted integer of type T, sign included
+template <typename T>
+constexpr std::size_t max_int_length = std::numeric_limits<T>::digits10 + 2;
+
+// Writes value in decimal to dst, padded with leading zeros to width
+// characters (the sign included, like printf's "%0*d").  dst must have room
+// for max(width, max_int_length<T>) characters.  Returns the end of the
+// output.
+template <typename T>
+char*
+format_int (T value, char* dst, int width = 0) {
+    static_assert (std::is_integral_v<T>, "format_int requires an integral type");
+
+    char        buf[max_int_length<T>];
+    const char* end    = std::to_chars (buf, buf + sizeof buf, value).ptr;
+    const char* digits = buf;
+    if constexpr (std::is_signed_v<T>) {
+        if (value < 0) {
+            *dst++ = '-';
+            ++digits;
+            --width;
+        }
+    }
+    for (auto pad = width - (end - digits); pad > 0; --pad)
+        *dst++ = '0';
+    return std::copy (digits, end, dst);
+}
+
+template <typename T>
+std::string
+format_int (T value, int width = 0) {
+    char buf[max_int_length<T>];
+    if (width <= static_cast<int> (sizeof buf))
+        return std::string (buf, format_int (value, buf, width));
+
+    std::string str (static_cast<std::size_t> (width), '\0');
+    str.resize (format_int (value, str.data(), width) - str.data());
+    return str;
+}
+
+// Writes the shortest representation of value which parses back to the same
+// number.  dst must have room for 32 characters.  Returns the end of the
+// output.
+char*
+format_double (double value, char* dst);
+
+std::string
+format_double (double value);
+
+}  // namespace gpw::str
+
+#endif
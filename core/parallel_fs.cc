@@ -0,0 +1,332 @@
+#include "core/parallel_fs.h"
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace gpw::filesystem {
+
+namespace {
+
+// State of an operation, shared with its jobs
+class operation {
+  public:
+    operation (gpw::concurrency::thread_pool& pool, std::size_t max_in_flight)
+        : _pool{pool},
+          _max_in_flight{static_cast<std::ptrdiff_t> (
+              std::clamp<std::size_t> (max_in_flight, 1, limit_in_flight)
+          )},
+          _slots{_max_in_flight} {}
+
+    operation (const operation&)            = delete;
+    operation& operator= (const operation&) = delete;
+
+    // Waits for the jobs, in case the walk threw.
+    ~operation () {
+        wait();
+    }
+
+    // Queues job, which processes path, once fewer than max_in_flight jobs
+    // are running.  An exception of job is reported as the error of path.
+    template <typename F>
+    void
+    run (fs::path path, F job) {
+        _slots.acquire();
+        ++_queued;
+        try {
+            _pool.queue_job ([this, path = std::move (path), job = std::move (job)] {
+                const slot_guard slot{_slots};
+                try {
+                    job();
+                } catch (const std::exception& e) {
+                    fail (path, e.what());
+                } catch (...) {
+                    fail (path, "Unknown error");
+                }
+            });
+        } catch (...) {
+            --_queued;
+            _slots.release();
+            throw;
+        }
+    }
+
+    // Waits for the jobs queued so far.
+    void
+    wait () {
+        if (_queued == 0) return;
+        for (std::ptrdiff_t i = 0; i < _max_in_flight; ++i)
+            _slots.acquire();
+        for (std::ptrdiff_t i = 0; i < _max_in_flight; ++i)
+            _slots.release();
+        _queued = 0;
+    }
+
+    void
+    fail (const fs::path& path, std::string message) {
+        std::lock_guard lock{_mutex};
+        _result.errors.push_back ({path, std::move (message)});
+    }
+
+    void
+    fail (const fs::path& path, const std::error_code& error) {
+        fail (path, error.message());
+    }
+
+    void
+    add_file (copy_method method = copy_method::none, std::uint64_t bytes = 0) {
+        std::lock_guard lock{_mutex};
+        ++_result.count_files;
+        _result.bytes += bytes;
+        _result.method = std::max (_result.method, method);
+    }
+
+    void
+    add_directory (copy_method method = copy_method::none) {
+        std::lock_guard lock{_mutex};
+        ++_result.count_directories;
+        _result.method = std::max (_result.method, method);
+    }
+
+    tree_result
+    finish () {
+        wait();
+        std::sort (
+            _result.errors.begin(), _result.errors.end(),
+            [] (const item_error& a, const item_error& b) { return a.path < b.path; }
+        );
+        return std::move (_result);
+    }
+
+  private:
+    // Releases the slot of a job however it ends
+    struct slot_guard {
+        gpw::concurrency::semaphore& slots;
+
+        ~slot_guard () {
+            slots.release();
+        }
+    };
+
+    gpw::concurrency::thread_pool& _pool;
+    const std::ptrdiff_t           _max_in_flight;
+    gpw::concurrency::semaphore    _slots;
+    std::size_t                    _queued = 0;
+
+    std::mutex  _mutex;
+    tree_result _result;
+};
+
+void
+check_directory (const fs::path& dir) {
+    if (!fs::is_directory (dir))
+        throw std::runtime_error{"The directory '" + dir.string() + "' does not exist"};
+}
+
+// Lists the entries of dir, or reports the error and returns nothing.
+std::vector<fs::path>
+list (operation& op, const fs::path& dir) {
+    std::vector<fs::path> entries;
+    std::error_code       error;
+    for (fs::directory_iterator it{dir, error}, end; !error && it != end; it.increment (error))
+        entries.push_back (it->path());
+    if (error) op.fail (dir, error);
+    return entries;
+}
+
+bool
+check_absent (operation& op, const fs::path& item, const fs::path& target) {
+    std::error_code error;
+    if (!fs::exists (fs::symlink_status (target, error))) return true;
+    op.fail (item, "The destination '" + target.string() + "' already exists");
+    return false;
+}
+
+// Copies the tree of item to target, which does not exist.  If remove_source,
+// the files are removed once copied, and the directories are appended to
+// dirs for remove_directories.
+void
+copy_tree (
+    operation&             op,
+    const fs::path&        item,
+    const fs::path&        target,
+    bool                   remove_source,
+    std::vector<fs::path>& dirs
+) {
+    std::vector<std::pair<fs::path, fs::path>> pending{{item, target}};
+    while (!pending.empty()) {
+        const auto [from, to] = std::move (pending.back());
+        pending.pop_back();
+
+        std::error_code error;
+        const auto      status = fs::symlink_status (from, error);
+        if (error) {
+            op.fail (from, error);
+        } else if (fs::is_directory (status)) {
+            if (!fs::create_directory (to, from, error)) {
+                if (error) op.fail (from, error);
+                else op.fail (from, "The destination '" + to.string() + "' already exists");
+                continue;
+            }
+            op.add_directory();
+            if (remove_source) dirs.push_back (from);
+            for (auto& entry : list (op, from)) {
+                auto entry_target = to / entry.filename();
+                pending.emplace_back (std::move (entry), std::move (entry_target));
+            }
+        } else if (fs::is_symlink (status)) {
+            fs::copy_symlink (from, to, error);
+            if (!error && remove_source) fs::remove (from, error);
+            if (error) op.fail (from, error);
+            else op.add_file();
+        } else {
+            op.run (from, [&op, from, to, remove_source] {
+                const copy_method method = copy_regular_file (from, to);
+                const std::uint64_t bytes = fs::file_size (to);
+                if (remove_source) fs::remove (from);
+                op.add_file (method, bytes);
+            });
+        }
+    }
+}
+
+// Removes the directories, which the walk listed parents first, once the jobs
+// have emptied them.  A directory which still holds an item that failed is
+// left without another error.
+void
+remove_directories (operation& op, const std::vector<fs::path>& dirs, bool count) {
+    op.wait();
+    for (auto dir = dirs.rbegin(); dir != dirs.rend(); ++dir) {
+        std::error_code error;
+        fs::remove (*dir, error);
+        if (!error) {
+            if (count) op.add_directory();
+        } else if (error != std::errc::directory_not_empty) {
+            op.fail (*dir, error);
+        }
+    }
+}
+
+// Moves the contents of src into dst, renaming the items unless copy_only
+tree_result
+move_contents (
+    const fs::path&                 src,
+    const fs::path&                 dst,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     max_in_flight,
+    bool                            copy_only
+) {
+    check_directory (src);
+    check_directory (dst);
+
+    // Listed before moving the items, so that the iteration does not see the
+    // directory change
+    operation             op{pool, max_in_flight};
+    std::vector<fs::path> dirs;
+    for (const auto& item : list (op, src)) {
+        const fs::path target = dst / item.filename();
+        if (!check_absent (op, item, target)) continue;
+
+        std::error_code error;
+        const bool      is_directory = fs::is_directory (fs::symlink_status (item, error));
+        if (copy_only) error = std::make_error_code (std::errc::cross_device_link);
+        else fs::rename (item, target, error);
+        if (!error) {
+            if (is_directory) op.add_directory (copy_method::rename);
+            else op.add_file (copy_method::rename);
+        } else if (error == std::errc::cross_device_link) {
+            copy_tree (op, item, target, true, dirs);
+        } else {
+            op.fail (item, error);
+        }
+    }
+    remove_directories (op, dirs, false);
+    return op.finish();
+}
+
+}  // namespace
+
+tree_result
+copy_directory_contents_parallel (
+    const fs::path&                 src,
+    const fs::path&                 dst,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     max_in_flight
+) {
+    check_directory (src);
+    check_directory (dst);
+
+    operation             op{pool, max_in_flight};
+    std::vector<fs::path> unused;
+    for (const auto& item : list (op, src)) {
+        const fs::path target = dst / item.filename();
+        if (check_absent (op, item, target)) copy_tree (op, item, target, false, unused);
+    }
+    return op.finish();
+}
+
+tree_result
+move_directory_contents_parallel (
+    const fs::path&                 src,
+    const fs::path&                 dst,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     max_in_flight
+) {
+    return move_contents (src, dst, pool, max_in_flight, false);
+}
+
+namespace detail {
+
+tree_result
+move_directory_contents_by_copy (
+    const fs::path&                 src,
+    const fs::path&                 dst,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     max_in_flight
+) {
+    return move_contents (src, dst, pool, max_in_flight, true);
+}
+
+}  // namespace detail
+
+tree_result
+remove_all_contents_parallel (
+    const fs::path&                 dir,
+    gpw::concurrency::thread_pool& pool,
+    bool                            delete_directory,
+    std::size_t                     max_in_flight
+) {
+    check_directory (dir);
+
+    operation             op{pool, max_in_flight};
+    std::vector<fs::path> dirs;
+    if (delete_directory) dirs.push_back (dir);
+
+    std::vector<fs::path> pending = list (op, dir);
+    while (!pending.empty()) {
+        const fs::path item = std::move (pending.back());
+        pending.pop_back();
+
+        std::error_code error;
+        const auto      status = fs::symlink_status (item, error);
+        if (error) {
+            op.fail (item, error);
+        } else if (fs::is_directory (status)) {
+            dirs.push_back (item);
+            for (auto& entry : list (op, item))
+                pending.push_back (std::move (entry));
+        } else {
+            op.run (item, [&op, item] {
+                fs::remove (item);
+                op.add_file();
+            });
+        }
+    }
+    remove_directories (op, dirs, true);
+    return op.finish();
+}
+
+}  // namespace gpw::filesystem
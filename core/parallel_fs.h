@@ -0,0 +1,109 @@
+// -----------------------------------------------------------------------------
+// Parallel directory operations
+// -----------------------------------------------------------------------------
+#ifndef gpw_parallel_fs_h
+#define gpw_parallel_fs_h
+
+#include "core/concurrency.h"
+#include "core/filesystem.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gpw::filesystem {
+
+// Copy, move and remove directory trees in parallel
+//
+// The tree is walked once by the calling thread, which creates the
+// directories, and the files are copied or removed by jobs on the pool, at
+// most max_in_flight at a time, so that the filesystem sees many concurrent
+// requests (which NVMe drives and network filesystems serve several times
+// faster than one at a time) without queuing the whole tree.  An item which
+// fails is reported in the errors of the result, with its subtree skipped,
+// and the other items are processed.  Symbolic links are copied as links.
+//
+// The pool must have been started, and these functions must not be called
+// from one of its jobs.  They throw runtime_error only if src or dst is not a
+// directory.
+//
+//   gpw::concurrency::thread_pool pool;
+//   pool.start();
+//   const auto result = copy_directory_contents_parallel (src, dst, pool);
+//   for (const auto& error : result.errors)
+//       gpw::warn ("{}: {}", error.path.string(), error.message);
+
+// max_in_flight is clamped to [1, limit_in_flight], so that e.g. SIZE_MAX
+// means as many as possible.
+constexpr std::size_t default_max_in_flight = 64;
+constexpr std::size_t limit_in_flight       = 4096;
+
+struct item_error {
+    fs::path    path;  // In the source tree
+    std::string message;
+};
+
+struct tree_result {
+    // Items processed; an item moved by a rename counts as one, whatever it
+    // contains.
+    std::size_t   count_files       = 0;  // Including symbolic links
+    std::size_t   count_directories = 0;
+    std::uint64_t bytes             = 0;  // Of the files copied
+
+    copy_method             method = copy_method::none;  // The slowest used
+    std::vector<item_error> errors;                      // By path
+
+    bool
+    ok () const {
+        return errors.empty();
+    }
+};
+
+// Copies the contents of src into dst.  Items which already exist in dst are
+// reported as errors.
+tree_result
+copy_directory_contents_parallel (
+    const fs::path&                 src,
+    const fs::path&                 dst,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     max_in_flight = default_max_in_flight
+);
+
+// Moves the contents of src into dst: each item is renamed if src and dst
+// are on the same filesystem, and otherwise copied, the files being removed
+// as they are copied and the directories once emptied.
+tree_result
+move_directory_contents_parallel (
+    const fs::path&                 src,
+    const fs::path&                 dst,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     max_in_flight = default_max_in_flight
+);
+
+namespace detail {
+
+// move_directory_contents_parallel as if src and dst were on different
+// filesystems, for tests
+tree_result
+move_directory_contents_by_copy (
+    const fs::path&                 src,
+    const fs::path&                 dst,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     max_in_flight = default_max_in_flight
+);
+
+}  // namespace detail
+
+// Removes the contents of dir, and dir itself if delete_directory is true.
+tree_result
+remove_all_contents_parallel (
+    const fs::path&                 dir,
+    gpw::concurrency::thread_pool& pool,
+    bool                            delete_directory = false,
+    std::size_t                     max_in_flight    = default_max_in_flight
+);
+
+}  // namespace gpw::filesystem
+
+#endif
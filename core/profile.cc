@@ -0,0 +1,258 @@
+#include "core/profile.h"
+#include "core/number.h"
+#include "core/str.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace gpw::profile {
+
+using gpw::util::dt::tsc_clock;
+
+// Ring buffer of the events of a thread.  Only the thread writes the slots and
+// the counters; collect() reads them.
+class thread_buffer {
+  public:
+    struct slot {
+        std::atomic<const char*>   name{nullptr};
+        std::atomic<std::uint64_t> begin{0};
+        std::atomic<std::uint64_t> end{0};
+        std::atomic<std::uint32_t> depth{0};
+    };
+
+    explicit thread_buffer (std::uint32_t id) : id{id} {}
+
+    void
+    push (const char* name, std::uint64_t begin, std::uint64_t end, std::uint32_t depth) {
+        const std::uint64_t h = head.load (std::memory_order_relaxed);
+
+        // Announce the slot before overwriting it (see collect).
+        claimed.store (h + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        slot& s = slots[h & mask];
+        s.name.store (name, std::memory_order_relaxed);
+        s.begin.store (begin, std::memory_order_relaxed);
+        s.end.store (end, std::memory_order_relaxed);
+        s.depth.store (depth, std::memory_order_relaxed);
+        head.store (h + 1, std::memory_order_release);
+    }
+
+    const std::uint32_t id;
+
+    // Allocated on the first event, before head is published
+    std::unique_ptr<slot[]> slots;
+    std::uint64_t           mask = 0;
+
+    std::atomic<std::uint64_t> claimed{0};  // Events started
+    std::atomic<std::uint64_t> head{0};     // Events published
+
+    // Guarded by the registry's mutex
+    std::string   name;
+    std::uint64_t read = 0;  // Events collected or dropped
+
+    std::atomic<bool> finished{false};
+};
+
+namespace {
+
+struct registry {
+    std::mutex                                  mutex;
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    std::uint32_t                               next_id = 1;
+    std::atomic<std::size_t>                    capacity{std::size_t{1} << 16};
+    std::atomic<std::uint64_t>                  origin{0};
+};
+
+// Never destroyed, so that threads which exit after main can still reach it.
+registry&
+the_registry () {
+    static registry* const r = new registry;
+    return *r;
+}
+
+// Marks the buffer of a thread as finished when the thread exits, so that
+// collect() can drop it once it is drained.
+struct buffer_owner {
+    std::shared_ptr<thread_buffer> buffer;
+
+    ~buffer_owner () {
+        if (buffer) buffer->finished.store (true, std::memory_order_release);
+    }
+};
+
+// Name of the thread until it records its first zone
+thread_local std::string pending_name;
+
+// The buffer of the calling thread, registered on its first zone, so that
+// threads which never record one (e.g. while the profiler is disabled) cost
+// the registry nothing.
+thread_buffer&
+current_buffer () {
+    thread_state& state = this_thread_state;
+    if (state.buffer != nullptr) return *state.buffer;
+
+    thread_local buffer_owner owner;
+    registry&                 r = the_registry();
+    std::lock_guard           lock{r.mutex};
+    owner.buffer       = std::make_shared<thread_buffer> (r.next_id++);
+    owner.buffer->name = std::move (pending_name);
+    r.buffers.push_back (owner.buffer);
+    state.buffer = owner.buffer.get();
+    return *state.buffer;
+}
+
+}  // namespace
+
+void
+enable (bool on) {
+    if (on) {
+        std::uint64_t unset = 0;
+        the_registry().origin.compare_exchange_strong (unset, tsc_clock::ticks());
+    }
+    is_enabled.store (on, std::memory_order_relaxed);
+}
+
+bool
+enabled () {
+    return is_enabled.load (std::memory_order_relaxed);
+}
+
+void
+set_sampling (std::uint32_t n) {
+    sampling.store (std::max<std::uint32_t> (n, 1), std::memory_order_relaxed);
+}
+
+void
+set_buffer_capacity (std::size_t events) {
+    std::size_t capacity = 1;
+    while (capacity < events)
+        capacity *= 2;
+    the_registry().capacity.store (capacity, std::memory_order_relaxed);
+}
+
+void
+set_thread_name (std::string name) {
+    thread_buffer* const buffer = this_thread_state.buffer;
+    if (buffer == nullptr) {
+        pending_name = std::move (name);
+        return;
+    }
+    std::lock_guard lock{the_registry().mutex};
+    buffer->name = std::move (name);
+}
+
+void
+run_in_zone (const char* name, const std::function<void()>& f) {
+#if !defined(GPW_NO_PROFILE)
+    const zone z{name};
+#endif
+    f();
+}
+
+void
+record (const char* name, std::uint64_t begin, std::uint64_t end, std::uint32_t depth) {
+    thread_buffer& buffer = current_buffer();
+    if (!buffer.slots) {
+        const std::size_t capacity = the_registry().capacity.load (std::memory_order_relaxed);
+        buffer.slots.reset (new thread_buffer::slot[capacity]);
+        buffer.mask = capacity - 1;
+    }
+    buffer.push (name, begin, end, depth);
+}
+
+trace
+collect () {
+    registry&       r = the_registry();
+    std::lock_guard lock{r.mutex};
+
+    trace result;
+    for (const auto& buffer : r.buffers) {
+        std::string name = buffer->name;
+        if (name.empty()) name = "thread " + std::to_string (buffer->id);
+        result.threads.emplace_back (buffer->id, std::move (name));
+
+        const std::uint64_t head = buffer->head.load (std::memory_order_acquire);
+        if (head == buffer->read) continue;
+
+        // The oldest events may have been overwritten before this call, or be
+        // overwritten while they are copied: the thread announces the slot
+        // it is about to write in claimed before writing it, so any slot
+        // below claimed - capacity after the copy may be torn.
+        const std::uint64_t capacity = buffer->mask + 1;
+        const std::uint64_t oldest   = (head > capacity) ? head - capacity : 0;
+        const std::uint64_t from     = std::max (buffer->read, oldest);
+        const std::size_t   first    = result.events.size();
+        for (std::uint64_t i = from; i < head; ++i) {
+            const auto& s = buffer->slots[i & buffer->mask];
+            result.events.push_back (
+                {s.name.load (std::memory_order_relaxed), s.begin.load (std::memory_order_relaxed),
+                 s.end.load (std::memory_order_relaxed), buffer->id,
+                 s.depth.load (std::memory_order_relaxed)}
+            );
+        }
+        std::atomic_thread_fence (std::memory_order_acquire);
+        const std::uint64_t claimed = buffer->claimed.load (std::memory_order_relaxed);
+        const std::uint64_t torn    = std::min (
+            head - from, (claimed > from + capacity) ? claimed - from - capacity : 0
+        );
+        result.events.erase (
+            result.events.begin() + first, result.events.begin() + first + torn
+        );
+        result.dropped += from - buffer->read + torn;
+        buffer->read    = head;
+    }
+
+    r.buffers.erase (
+        std::remove_if (
+            r.buffers.begin(), r.buffers.end(),
+            [] (const auto& buffer) {
+                return buffer->finished.load (std::memory_order_acquire)
+                    && buffer->head.load (std::memory_order_acquire) == buffer->read;
+            }
+        ),
+        r.buffers.end()
+    );
+
+    std::sort (
+        result.events.begin(), result.events.end(),
+        [] (const event& a, const event& b) {
+            return a.begin != b.begin ? a.begin < b.begin : a.depth < b.depth;
+        }
+    );
+    return result;
+}
+
+std::string
+trace::to_json () const {
+    const std::uint64_t origin = the_registry().origin.load (std::memory_order_relaxed);
+    auto                append_usec = [] (std::string& out, std::uint64_t ticks) {
+        out += gpw::str::format_double (tsc_clock::to_nsec (ticks) / 1000);
+    };
+
+    std::string out = "{\"traceEvents\": [";
+    const char* separator = "\n";
+    for (const auto& e : events) {
+        out += separator;
+        out += "{\"name\": ";
+        gpw::str::append_json_string (out, e.name);
+        out += ", \"ph\": \"X\", \"pid\": 1, \"tid\": " + std::to_string (e.thread) + ", \"ts\": ";
+        append_usec (out, e.begin > origin ? e.begin - origin : 0);
+        out += ", \"dur\": ";
+        append_usec (out, e.end > e.begin ? e.end - e.begin : 0);
+        out += '}';
+        separator = ",\n";
+    }
+    for (const auto& [id, name] : threads) {
+        out += separator;
+        out += "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": ";
+        out += std::to_string (id) + ", \"args\": {\"name\": ";
+        gpw::str::append_json_string (out, name);
+        out += "}}";
+        separator = ",\n";
+    }
+    out += "\n], \"displayTimeUnit\": \"ns\"}\n";
+    return out;
+}
+
+}  // namespace gpw::profile
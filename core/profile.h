@@ -0,0 +1,152 @@
+// -----------------------------------------------------------------------------
+// Profiling zones
+// -----------------------------------------------------------------------------
+#ifndef gpw_profile_h
+#define gpw_profile_h
+
+#include "core/date_time.h"
+#include "core/profile_hooks.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Times the rest of the enclosing scope as a zone named name, which must be a
+// string literal (or otherwise outlive the profiler).  Compiled out if
+// GPW_NO_PROFILE is defined.
+//
+//   void
+//   handle (const request& req) {
+//       GPW_PROFILE_ZONE ("handle");
+//       ...
+//       {
+//           GPW_PROFILE_ZONE ("parse");
+//           ...
+//       }
+//   }
+#if defined(GPW_NO_PROFILE)
+#define GPW_PROFILE_ZONE(name) static_cast<void> (0)
+#else
+#define GPW_PROFILE_CONCAT_(a, b) a##b
+#define GPW_PROFILE_CONCAT(a, b)  GPW_PROFILE_CONCAT_ (a, b)
+#define GPW_PROFILE_ZONE(name) \
+    const ::gpw::profile::zone GPW_PROFILE_CONCAT (gpw_profile_zone_, __LINE__) { name }
+#endif
+
+namespace gpw::profile {
+
+// Zones are timed with tsc_clock and recorded by each thread into its own ring
+// buffer, without locks: the thread publishes an event with a release store of
+// the buffer's head, and collect() copies the events and discards those which
+// the thread overwrote meanwhile.  A zone costs two clock readings and a few
+// stores, and a check of a flag when the profiler is disabled (the default).
+//
+// With sampling, only one in n of the outermost zones of a thread is recorded,
+// with all the zones nested in it.
+//
+//   gpw::profile::enable();
+//   ...
+//   std::ofstream{"trace.json"} << gpw::profile::collect().to_json();
+//
+// The trace opens in chrome://tracing or https://ui.perfetto.dev.
+
+// Recorded zone.  begin and end are in tsc_clock ticks.
+struct event {
+    const char*   name;
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::uint32_t thread;
+    std::uint32_t depth;  // 0 for an outermost zone
+};
+
+struct trace {
+    std::vector<event>                                  events;   // By begin
+    std::vector<std::pair<std::uint32_t, std::string>> threads;  // Ids and names
+    std::uint64_t                                       dropped = 0;
+
+    // Chrome trace event format: complete ("X") events with microsecond
+    // times from the first enable(), and the thread names as metadata.
+    std::string
+    to_json () const;
+};
+
+void
+enable (bool on = true);
+
+bool
+enabled ();
+
+// Records one in n outermost zones per thread (1 records them all).
+void
+set_sampling (std::uint32_t n);
+
+// Capacity in events of the buffers of the threads which record their first
+// zone afterwards.  Rounded up to a power of 2.
+void
+set_buffer_capacity (std::size_t events);
+
+// Moves the events recorded since the last call out of the buffers.  The
+// events which were overwritten before they were collected are counted as
+// dropped.
+trace
+collect ();
+
+class thread_buffer;
+
+// Per thread state of the zones
+struct thread_state {
+    thread_buffer* buffer;
+    std::uint32_t  depth;
+    std::uint32_t  until_sample;  // Outermost zones to skip
+    bool           sampled;       // Whether the current outermost zone is
+};
+
+inline thread_local thread_state this_thread_state{};
+
+inline std::atomic<bool>          is_enabled{false};
+inline std::atomic<std::uint32_t> sampling{1};
+
+// Records a zone of the calling thread.
+void
+record (const char* name, std::uint64_t begin, std::uint64_t end, std::uint32_t depth);
+
+// Times its lifetime; see GPW_PROFILE_ZONE.
+class zone {
+  public:
+    explicit zone (const char* name) : _name{name} {
+        if (!is_enabled.load (std::memory_order_relaxed)) return;
+
+        thread_state& state = this_thread_state;
+        if (state.depth == 0) {
+            state.sampled = state.until_sample == 0;
+            if (state.sampled) state.until_sample = sampling.load (std::memory_order_relaxed) - 1;
+            else --state.until_sample;
+        }
+        ++state.depth;
+        _open = true;
+        if (state.sampled) _begin = gpw::util::dt::tsc_clock::ticks();
+    }
+
+    zone (const zone&)            = delete;
+    zone& operator= (const zone&) = delete;
+
+    ~zone () {
+        if (!_open) return;
+        thread_state& state = this_thread_state;
+        --state.depth;
+        if (state.sampled) record (_name, _begin, gpw::util::dt::tsc_clock::ticks(), state.depth);
+    }
+
+  private:
+    const char*   _name;
+    std::uint64_t _begin = 0;
+    bool          _open  = false;
+};
+
+}  // namespace gpw::profile
+
+#endif
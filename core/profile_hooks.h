@@ -0,0 +1,26 @@
+// -----------------------------------------------------------------------------
+// Profiling hooks
+// -----------------------------------------------------------------------------
+#ifndef gpw_profile_hooks_h
+#define gpw_profile_hooks_h
+
+#include <functional>
+#include <string>
+
+// The functions of the profiler (core/profile.h) which infrastructure such as
+// the thread pool calls, declared without the profiler's dependencies.
+namespace gpw::profile {
+
+// Names the calling thread in the traces.
+void
+set_thread_name (std::string name);
+
+// Calls f in a zone named name, which must outlive the profiler (e.g. a
+// string literal).  The zone is compiled out with GPW_NO_PROFILE, like
+// GPW_PROFILE_ZONE in core/profile.cc.
+void
+run_in_zone (const char* name, const std::function<void()>& f);
+
+}  // namespace gpw::profile
+
+#endif
@@ -0,0 +1,94 @@
+#include "core/progress.h"
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace gpw::util::dt {
+
+progress_meter::progress_meter (std::uint64_t total, double half_life_sec, double window_sec)
+    : _total{total}, _tau_nsec{half_life_sec * 1e9 / std::log (2.0)},
+      _window_nsec{window_sec * 1e9} {
+    restart();
+}
+
+std::uint64_t
+progress_meter::done () const {
+    std::uint64_t sum = 0;
+    for (const auto& s : _stripes)
+        sum += s.count.load (std::memory_order_relaxed);
+    return sum;
+}
+
+progress_snapshot
+progress_meter::update (std::int64_t now) {
+    std::lock_guard lock{_mutex};
+
+    progress_snapshot snapshot;
+    snapshot.done        = done();
+    snapshot.total       = total();
+    snapshot.elapsed_sec = static_cast<double> (now - _start) / 1e9;
+    if (now > _start) snapshot.average_rate = snapshot.done / snapshot.elapsed_sec;
+
+    const auto interval = static_cast<double> (now - _last_time);
+    if (interval > 0 && snapshot.done >= _last_done) {
+        const double rate = static_cast<double> (snapshot.done - _last_done) * 1e9 / interval;
+        if (_has_ewma) {
+            _ewma += (1 - std::exp (-interval / _tau_nsec)) * (rate - _ewma);
+        } else {
+            _ewma     = rate;
+            _has_ewma = true;
+        }
+        _last_time = now;
+        _last_done = snapshot.done;
+    }
+    snapshot.ewma_rate = _ewma;
+
+    // Keep the latest sample at or before the start of the window.
+    _window.emplace_back (now, snapshot.done);
+    while (_window.size() > 1 && static_cast<double> (now - _window[1].first) >= _window_nsec)
+        _window.pop_front();
+    const auto [first_time, first_done] = _window.front();
+    if (now > first_time && snapshot.done >= first_done) {
+        snapshot.window_rate =
+            static_cast<double> (snapshot.done - first_done) * 1e9 / (now - first_time);
+    }
+
+    if (snapshot.total != 0 && snapshot.done >= snapshot.total) snapshot.eta_sec = 0;
+    else if (snapshot.total != 0 && _ewma > 0)
+        snapshot.eta_sec = static_cast<double> (snapshot.total - snapshot.done) / _ewma;
+    else snapshot.eta_sec = std::numeric_limits<double>::infinity();
+    return snapshot;
+}
+
+void
+progress_meter::restart (std::int64_t start) {
+    std::lock_guard lock{_mutex};
+    for (auto& s : _stripes)
+        s.count.store (0, std::memory_order_relaxed);
+    _start     = start;
+    _last_time = start;
+    _last_done = 0;
+    _ewma      = 0;
+    _has_ewma  = false;
+    _window.assign (1, {start, 0});
+}
+
+std::string
+progress_snapshot::to_string () const {
+    char buf[128];
+    int  length = std::snprintf (buf, sizeof buf, "%llu", static_cast<unsigned long long> (done));
+    if (total != 0) {
+        length += std::snprintf (
+            buf + length, sizeof buf - length, "/%llu (%.1f%%)",
+            static_cast<unsigned long long> (total), 100.0 * done / total
+        );
+    }
+    std::snprintf (buf + length, sizeof buf - length, " %.1f/s ETA ", ewma_rate);
+
+    std::string str = buf;
+    str += std::isfinite (eta_sec) ? dt::to_string (static_cast<long> (eta_sec * 1000)) : "--";
+    return str;
+}
+
+}  // namespace gpw::util::dt
@@ -0,0 +1,132 @@
+// -----------------------------------------------------------------------------
+// Progress and throughput
+// -----------------------------------------------------------------------------
+#ifndef gpw_progress_h
+#define gpw_progress_h
+
+#include "core/date_time.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace gpw::util::dt {
+
+struct progress_snapshot {
+    std::uint64_t done        = 0;
+    std::uint64_t total       = 0;  // 0 if unknown
+    double        elapsed_sec = 0;
+
+    // Items per second: since the start, exponentially weighted moving
+    // average, and over the sliding window
+    double average_rate = 0;
+    double ewma_rate    = 0;
+    double window_rate  = 0;
+
+    // Remaining seconds at the EWMA rate; infinity if the total is unknown or
+    // nothing has been done yet
+    double eta_sec = 0;
+
+    // e.g. "1234/10000 (12.3%) 456.7/s ETA 00:01:23.000"
+    std::string
+    to_string () const;
+};
+
+// Concurrent progress meter
+//
+// Workers count done items with add(), which is a relaxed atomic increment of
+// one of several counters on separate cache lines, so that many threads can
+// update the meter without contending.  A reporter calls update()
+// periodically (e.g. every second), which sums the counters and updates the
+// rates: the EWMA, with a weight depending on the time since the previous
+// update so that irregular updates do not bias it, gives a stable rate for the
+// ETA, and the sliding window rate reacts faster to changes of throughput.
+//
+//   progress_meter          meter{files.size()};
+//   gpw::concurrency::latch done (files.size());
+//   for (const auto& file : files)
+//       pool.queue_job ([&, file] { process (file); meter.add(); done.count_down(); });
+//   while (meter.done() < meter.total()) {
+//       std::this_thread::sleep_for (std::chrono::seconds{1});
+//       std::cerr << meter.update().to_string() << '\r';
+//   }
+//   done.wait();
+class progress_meter {
+  public:
+    // The EWMA gives the rate of half_life_sec ago half the weight of the
+    // current one.
+    explicit progress_meter (
+        std::uint64_t total = 0, double half_life_sec = 10, double window_sec = 60
+    );
+
+    progress_meter (const progress_meter&)            = delete;
+    progress_meter& operator= (const progress_meter&) = delete;
+
+    void
+    add (std::uint64_t count = 1) {
+        _stripes[_stripe_index()].count.fetch_add (count, std::memory_order_relaxed);
+    }
+
+    std::uint64_t
+    done () const;
+
+    void
+    set_total (std::uint64_t total) {
+        _total.store (total, std::memory_order_relaxed);
+    }
+
+    std::uint64_t
+    total () const {
+        return _total.load (std::memory_order_relaxed);
+    }
+
+    // Takes a sample at now (nanoseconds of now_nsec) and returns the
+    // progress.  Thread safe.
+    progress_snapshot
+    update (std::int64_t now = now_nsec());
+
+    // Zeroes the counts and the rates, and starts again at start.
+    void
+    restart (std::int64_t start = now_nsec());
+
+  private:
+    static constexpr std::size_t count_stripes = 16;
+
+    struct alignas (64) stripe {
+        std::atomic<std::uint64_t> count{0};
+    };
+
+    static std::size_t
+    _stripe_index () {
+        static std::atomic<std::size_t> next{0};
+        thread_local const std::size_t  index =
+            next.fetch_add (1, std::memory_order_relaxed) % count_stripes;
+        return index;
+    }
+
+    std::array<stripe, count_stripes> _stripes;
+    std::atomic<std::uint64_t>        _total;
+
+    const double _tau_nsec;  // Time constant of the EWMA
+    const double _window_nsec;
+
+    // Reporter state, guarded by _mutex
+    using sample = std::pair<std::int64_t, std::uint64_t>;  // Time and count
+
+    std::mutex         _mutex;
+    std::int64_t       _start;
+    std::int64_t       _last_time;
+    std::uint64_t      _last_done = 0;
+    double             _ewma      = 0;
+    bool               _has_ewma  = false;
+    std::deque<sample> _window;
+};
+
+}  // namespace gpw::util::dt
+
+#endif
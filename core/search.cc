@@ -0,0 +1,936 @@
+#include "core/search.h"
+#include "core/simd.h"
+#include "core/str.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace gpw::str {
+
+namespace {
+
+// In case insensitive mode the pattern is stored folded to lower case, and the
+// bytes of the text are folded as they are compared with it.
+template <bool IgnoreCase>
+inline char
+key (char c) {
+    if constexpr (IgnoreCase)
+        return static_cast<char> (gpw::simd::fold_lower (static_cast<unsigned char> (c)));
+    else return c;
+}
+
+// True if the n bytes at s match the n bytes of the pattern at p
+template <bool IgnoreCase>
+inline bool
+equal (const char* s, const char* p, std::size_t n) {
+    if constexpr (IgnoreCase) return equals_icase ({s, n}, {p, n});
+    else return std::memcmp (s, p, n) == 0;
+}
+
+// Calls on_match for every occurrence of pat in txt at or after pos using KMP,
+// stopping early when on_match returns false.
+template <bool IgnoreCase, typename F>
+void
+kmp_search (
+    std::string_view        pat,
+    std::string_view        txt,
+    std::size_t             pos,
+    const std::vector<int>& _llps,
+    F&&                     on_match
+) {
+    const std::size_t n = txt.length();
+    const std::size_t m = pat.length();
+
+    // Pointers i and j, for traversing
+    // the text and pattern
+    std::size_t i = pos;
+    std::size_t j = 0;
+
+    while (i < n) {
+        // If characters match, move both pointers forward
+        if (key<IgnoreCase> (txt[i]) == pat[j]) {
+            i++;
+            j++;
+
+            // If the entire pattern is matched report the start index
+            if (j == m) {
+                if (!on_match (i - j)) return;
+
+                // Use LPS of previous index to skip unnecessary comparisons
+                j = _llps[j - 1];
+            }
+        }
+
+        // If there is a mismatch
+        else {
+            // Use lps value of previous index to avoid redundant comparisons
+            if (j != 0) j = _llps[j - 1];
+            else i++;
+        }
+    }
+}
+
+// The candidate filter pays for verification with a work budget (in bytes).
+// Verifying a candidate costs the pattern length and every byte up to it
+// earns verify_credit bytes, once even if the scan resumes after a match.  A
+// candidate the budget cannot pay for is left to KMP, which continues the
+// search from it, so that matches as well as false candidates bound the work.
+constexpr std::ptrdiff_t verify_credit  = 8;
+constexpr std::ptrdiff_t initial_budget = 4096;
+
+struct scan_result {
+    enum { match, none, exhausted } status;
+    std::size_t pos;  // The match, or where to resume when exhausted
+};
+
+// Scans s[i, n) for the pattern p of length m >= 2.
+using scan_fn = scan_result (*) (
+    const char* s, std::size_t n, const char* p, std::size_t m, std::size_t i,
+    std::ptrdiff_t& budget
+);
+
+template <bool IgnoreCase>
+scan_result
+scan_scalar (
+    const char* s, std::size_t n, const char* p, std::size_t m, std::size_t i,
+    std::ptrdiff_t& budget
+) {
+    const char last = p[m - 1];
+    while (i + m <= n) {
+        std::size_t cand = i;
+        if constexpr (IgnoreCase) {
+            while (cand + m <= n && key<true> (s[cand]) != p[0])
+                ++cand;
+            if (cand + m > n) break;
+        } else {
+            const void* hit = std::memchr (s + i, p[0], n - m + 1 - i);
+            if (hit == nullptr) break;
+            cand = static_cast<const char*> (hit) - s;
+        }
+
+        budget += (cand - i + 1) * verify_credit;
+        if (key<IgnoreCase> (s[cand + m - 1]) == last) {
+            budget -= m;
+            if (budget < 0) return {scan_result::exhausted, cand};
+            if (equal<IgnoreCase> (s + cand + 1, p + 1, m - 2))
+                return {scan_result::match, cand};
+        }
+        i = cand + 1;
+    }
+    return {scan_result::none, std::string_view::npos};
+}
+
+#if defined(GPW_SIMD_X86)
+template <bool IgnoreCase>
+scan_result
+scan_sse2 (
+    const char* s, std::size_t n, const char* p, std::size_t m, std::size_t i,
+    std::ptrdiff_t& budget
+) {
+    const __m128i first    = _mm_set1_epi8 (p[0]);
+    const __m128i last     = _mm_set1_epi8 (p[m - 1]);
+    std::size_t   credited = i;  // The bytes before it have earned their credit
+
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i blk_first = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + i));
+        __m128i blk_last  = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + i + m - 1));
+        if constexpr (IgnoreCase) {
+            blk_first = gpw::simd::fold_sse2 (blk_first, 'A');
+            blk_last  = gpw::simd::fold_sse2 (blk_last, 'A');
+        }
+        std::uint32_t mask = _mm_movemask_epi8 (
+            _mm_and_si128 (_mm_cmpeq_epi8 (first, blk_first), _mm_cmpeq_epi8 (last, blk_last))
+        );
+
+        while (mask != 0) {
+            const std::size_t cand = i + gpw::simd::count_trailing_zeros (mask);
+            budget += (cand + 1 - credited) * verify_credit - m;
+            credited = cand + 1;
+            if (budget < 0) return {scan_result::exhausted, cand};
+            if (equal<IgnoreCase> (s + cand + 1, p + 1, m - 2))
+                return {scan_result::match, cand};
+            mask &= mask - 1;
+        }
+    }
+    budget += (i - std::min (i, credited)) * verify_credit;
+    return scan_scalar<IgnoreCase> (s, n, p, m, i, budget);
+}
+
+template <bool IgnoreCase>
+GPW_TARGET_AVX2 scan_result
+scan_avx2 (
+    const char* s, std::size_t n, const char* p, std::size_t m, std::size_t i,
+    std::ptrdiff_t& budget
+) {
+    const __m256i first    = _mm256_set1_epi8 (p[0]);
+    const __m256i last     = _mm256_set1_epi8 (p[m - 1]);
+    std::size_t   credited = i;  // The bytes before it have earned their credit
+
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i blk_first = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + i));
+        __m256i blk_last =
+            _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + i + m - 1));
+        if constexpr (IgnoreCase) {
+            blk_first = gpw::simd::fold_avx2 (blk_first, 'A');
+            blk_last  = gpw::simd::fold_avx2 (blk_last, 'A');
+        }
+        std::uint32_t mask = _mm256_movemask_epi8 (_mm256_and_si256 (
+            _mm256_cmpeq_epi8 (first, blk_first), _mm256_cmpeq_epi8 (last, blk_last)
+        ));
+
+        while (mask != 0) {
+            const std::size_t cand = i + gpw::simd::count_trailing_zeros (mask);
+            budget += (cand + 1 - credited) * verify_credit - m;
+            credited = cand + 1;
+            if (budget < 0) return {scan_result::exhausted, cand};
+            if (equal<IgnoreCase> (s + cand + 1, p + 1, m - 2))
+                return {scan_result::match, cand};
+            mask &= mask - 1;
+        }
+    }
+    budget += (i - std::min (i, credited)) * verify_credit;
+    return scan_scalar<IgnoreCase> (s, n, p, m, i, budget);
+}
+#endif
+
+template <bool IgnoreCase>
+scan_fn
+select_scan () {
+#if defined(GPW_SIMD_X86)
+    return gpw::simd::has_avx2() ? scan_avx2<IgnoreCase> : scan_sse2<IgnoreCase>;
+#else
+    return scan_scalar<IgnoreCase>;
+#endif
+}
+
+template <bool IgnoreCase, typename F>
+void
+byte_search (char c, std::string_view txt, std::size_t pos, F&& on_match) {
+    const std::size_t n = txt.length();
+    if (IgnoreCase && gpw::simd::fold_upper (static_cast<unsigned char> (c)) != c) {
+        for (; pos < n; ++pos)
+            if (key<true> (txt[pos]) == c && !on_match (pos)) return;
+        return;
+    }
+
+    while (pos < n) {
+        const void* hit = std::memchr (txt.data() + pos, c, n - pos);
+        if (hit == nullptr) return;
+
+        pos = static_cast<const char*> (hit) - txt.data();
+        if (!on_match (pos)) return;
+        ++pos;
+    }
+}
+
+// Vectorized search for patterns of length >= 2.  The KMP table is only
+// needed when the filter gives up; it is built on demand if not supplied.
+template <bool IgnoreCase, typename F>
+void
+vectorized_search (
+    std::string_view        pat,
+    std::string_view        txt,
+    std::size_t             pos,
+    const std::vector<int>* _llps,
+    F&&                     on_match
+) {
+    const std::size_t n = txt.length();
+    const std::size_t m = pat.length();
+
+    static const scan_fn scan   = select_scan<IgnoreCase>();
+    std::ptrdiff_t       budget = initial_budget;
+    while (pos + m <= n) {
+        const auto res = scan (txt.data(), n, pat.data(), m, pos, budget);
+        if (res.status == scan_result::none) return;
+        if (res.status == scan_result::exhausted) {
+            if (_llps) kmp_search<IgnoreCase> (pat, txt, res.pos, *_llps, on_match);
+            else kmp_search<IgnoreCase> (pat, txt, res.pos, llps (pat), on_match);
+            return;
+        }
+        if (!on_match (res.pos)) return;
+        pos = res.pos + 1;
+    }
+}
+
+template <bool IgnoreCase, typename F>
+void
+horspool_search (
+    std::string_view                    pat,
+    std::string_view                    txt,
+    std::size_t                         pos,
+    const std::array<std::size_t, 256>& shift,
+    F&&                                 on_match
+) {
+    const std::size_t n    = txt.length();
+    const std::size_t m    = pat.length();
+    const char        last = pat[m - 1];
+
+    while (pos + m <= n) {
+        const char c = txt[pos + m - 1];
+        if (key<IgnoreCase> (c) == last
+            && equal<IgnoreCase> (txt.data() + pos, pat.data(), m - 1)) {
+            if (!on_match (pos)) return;
+        }
+        pos += shift[static_cast<unsigned char> (c)];
+    }
+}
+
+// Computes the maximal suffix of x for the lexicographic order (or the reversed
+// order).  Returns the position preceding the suffix, which may be -1, and the
+// period of the suffix.
+std::pair<std::ptrdiff_t, std::size_t>
+maximal_suffix (std::string_view x, bool reversed) {
+    const auto     m  = static_cast<std::ptrdiff_t> (x.length());
+    std::ptrdiff_t ms = -1;
+    std::ptrdiff_t j  = 0;
+    std::ptrdiff_t k  = 1;
+    std::ptrdiff_t p  = 1;
+
+    while (j + k < m) {
+        const auto a = static_cast<unsigned char> (x[j + k]);
+        const auto b = static_cast<unsigned char> (x[ms + k]);
+        if (reversed ? a > b : a < b) {
+            j += k;
+            k = 1;
+            p = j - ms;
+        } else if (a == b) {
+            if (k != p) {
+                ++k;
+            } else {
+                j += p;
+                k = 1;
+            }
+        } else {
+            ms = j;
+            j  = ms + 1;
+            k = p = 1;
+        }
+    }
+    return {ms, static_cast<std::size_t> (p)};
+}
+
+// Two-Way search.  The pattern is split at the critical position ell; the
+// right part is matched left to right, then the left part right to left.
+template <bool IgnoreCase, typename F>
+void
+two_way_search (
+    std::string_view pat,
+    std::string_view txt,
+    std::size_t      pos,
+    std::ptrdiff_t   ell,
+    std::size_t      period,
+    bool             periodic,
+    F&&              on_match
+) {
+    const auto     n   = static_cast<std::ptrdiff_t> (txt.length());
+    const auto     m   = static_cast<std::ptrdiff_t> (pat.length());
+    const auto     per = static_cast<std::ptrdiff_t> (period);
+    std::ptrdiff_t j   = static_cast<std::ptrdiff_t> (pos);
+
+    if (periodic) {
+        // Length of the prefix known to match after a shift by the period
+        std::ptrdiff_t memory = -1;
+        while (j <= n - m) {
+            std::ptrdiff_t i = std::max (ell, memory) + 1;
+            while (i < m && pat[i] == key<IgnoreCase> (txt[i + j]))
+                ++i;
+            if (i >= m) {
+                i = ell;
+                while (i > memory && pat[i] == key<IgnoreCase> (txt[i + j]))
+                    --i;
+                if (i <= memory && !on_match (static_cast<std::size_t> (j))) return;
+                j += per;
+                memory = m - per - 1;
+            } else {
+                j += i - ell;
+                memory = -1;
+            }
+        }
+    } else {
+        while (j <= n - m) {
+            std::ptrdiff_t i = ell + 1;
+            while (i < m && pat[i] == key<IgnoreCase> (txt[i + j]))
+                ++i;
+            if (i >= m) {
+                i = ell;
+                while (i >= 0 && pat[i] == key<IgnoreCase> (txt[i + j]))
+                    --i;
+                if (i < 0 && !on_match (static_cast<std::size_t> (j))) return;
+                j += per;
+            } else {
+                j += i - ell;
+            }
+        }
+    }
+}
+
+struct factorization {
+    std::ptrdiff_t ell;     // Last position of the left part, may be -1
+    std::size_t    period;  // Shift applied after a match
+    bool           periodic;
+};
+
+factorization
+critical_factorization (std::string_view pat) {
+    const auto [i, p] = maximal_suffix (pat, false);
+    const auto [j, q] = maximal_suffix (pat, true);
+
+    factorization res = (i > j) ? factorization{i, p, false} : factorization{j, q, false};
+    res.periodic = std::memcmp (pat.data(), pat.data() + res.period, res.ell + 1) == 0;
+    if (!res.periodic)
+        res.period = std::max<std::size_t> (res.ell + 1, pat.length() - res.ell - 1) + 1;
+    return res;
+}
+
+bool
+small_alphabet (std::string_view pat) {
+    std::array<bool, 256> seen{};
+    std::size_t           distinct = 0;
+    for (const char c : pat) {
+        auto& s = seen[static_cast<unsigned char> (c)];
+        if (!s) {
+            s = true;
+            if (++distinct > 4) return false;
+        }
+    }
+    return true;
+}
+
+// The vectorized filter is the fastest choice unless a long pattern is drawn
+// from a small alphabet (DNA, binary, runs): candidates are then so frequent
+// that the filter falls back to KMP.  Horspool copes better there, and Two-Way
+// keeps periodic patterns linear where Horspool would rescan each match.
+searcher::algorithm
+choose_algorithm (std::string_view pat) {
+    if (pat.length() < 128 || !small_alphabet (pat)) return searcher::algorithm::vectorized;
+    return critical_factorization (pat).periodic ? searcher::algorithm::two_way
+                                                 : searcher::algorithm::horspool;
+}
+
+}  // namespace
+
+searcher::searcher (std::string_view pat, algorithm algo, bool ignore_case)
+    : _pat{pat}, _algo{algo}, _ignore_case{ignore_case} {
+    if (_ignore_case) to_lower_in_place (_pat);
+    if (_algo == algorithm::automatic) _algo = choose_algorithm (_pat);
+
+    const std::size_t m = _pat.length();
+    if (m < 2) return;
+
+    switch (_algo) {
+    case algorithm::vectorized:
+    case algorithm::kmp: _llps = llps (_pat); break;
+
+    case algorithm::horspool:
+        _shift.fill (m);
+        for (std::size_t i = 0; i + 1 < m; ++i) {
+            const auto c = static_cast<unsigned char> (_pat[i]);
+            _shift[c]    = m - 1 - i;
+            if (_ignore_case) _shift[gpw::simd::fold_upper (c)] = m - 1 - i;
+        }
+        break;
+
+    case algorithm::two_way: {
+        const auto f = critical_factorization (_pat);
+        _ell         = f.ell;
+        _period      = f.period;
+        _periodic    = f.periodic;
+        break;
+    }
+
+    default: break;
+    }
+}
+
+template <typename F>
+void
+searcher::_for_each (std::string_view txt, std::size_t pos, F&& on_match) const {
+    const std::size_t n = txt.length();
+    const std::size_t m = _pat.length();
+    if (m == 0 || m > n || pos > n - m) return;
+
+    if (_ignore_case) _search<true> (txt, pos, on_match);
+    else _search<false> (txt, pos, on_match);
+}
+
+template <bool IgnoreCase, typename F>
+void
+searcher::_search (std::string_view txt, std::size_t pos, F&& on_match) const {
+    if (_pat.length() == 1) {
+        byte_search<IgnoreCase> (_pat[0], txt, pos, on_match);
+        return;
+    }
+
+    switch (_algo) {
+    case algorithm::kmp: kmp_search<IgnoreCase> (_pat, txt, pos, _llps, on_match); break;
+    case algorithm::horspool:
+        horspool_search<IgnoreCase> (_pat, txt, pos, _shift, on_match);
+        break;
+    case algorithm::two_way:
+        two_way_search<IgnoreCase> (_pat, txt, pos, _ell, _period, _periodic, on_match);
+        break;
+    default: vectorized_search<IgnoreCase> (_pat, txt, pos, &_llps, on_match); break;
+    }
+}
+
+std::size_t
+searcher::find_first (std::string_view txt, std::size_t pos) const {
+    std::size_t res = std::string_view::npos;
+    _for_each (txt, pos, [&res] (std::size_t found) {
+        res = found;
+        return false;
+    });
+    return res;
+}
+
+std::size_t
+searcher::find_all (std::string_view txt, std::vector<std::size_t>& out) const {
+    out.clear();
+    _for_each (txt, 0, [&out] (std::size_t pos) {
+        out.push_back (pos);
+        return true;
+    });
+    return out.size();
+}
+
+std::size_t
+searcher::count (std::string_view txt) const {
+    std::size_t res = 0;
+    _for_each (txt, 0, [&res] (std::size_t) {
+        ++res;
+        return true;
+    });
+    return res;
+}
+
+// The free functions use the vectorized filter and build the KMP table only
+// when the filter gives up, so a single call costs no setup.
+namespace {
+
+template <typename T>
+void
+collect_matches (std::string_view pat, std::string_view txt, std::vector<T>& out) {
+    out.clear();
+    if (pat.empty() || pat.length() > txt.length()) return;
+
+    auto on_match = [&out] (std::size_t pos) {
+        out.push_back (static_cast<T> (pos));
+        return true;
+    };
+    if (pat.length() == 1) byte_search<false> (pat[0], txt, 0, on_match);
+    else vectorized_search<false> (pat, txt, 0, nullptr, on_match);
+}
+
+}  // namespace
+
+std::vector<int>
+search (std::string_view pat, std::string_view txt) {
+    if (txt.length() > static_cast<std::size_t> (std::numeric_limits<int>::max()))
+        throw std::runtime_error{"The text is too long for int positions"};
+
+    std::vector<int> res;
+    collect_matches (pat, txt, res);
+    return res;
+}
+
+std::size_t
+find_all (std::string_view pat, std::string_view txt, std::vector<std::size_t>& out) {
+    collect_matches (pat, txt, out);
+    return out.size();
+}
+
+std::size_t
+find_first (std::string_view pat, std::string_view txt, std::size_t pos) {
+    std::size_t res = std::string_view::npos;
+    if (pat.empty() || pat.length() > txt.length() || pos > txt.length() - pat.length())
+        return res;
+
+    auto on_match = [&res] (std::size_t found) {
+        res = found;
+        return false;
+    };
+    if (pat.length() == 1) byte_search<false> (pat[0], txt, pos, on_match);
+    else vectorized_search<false> (pat, txt, pos, nullptr, on_match);
+    return res;
+}
+
+// Size of the dense transition rows, which hold the hot shallow states
+constexpr std::size_t dense_table_bytes = 128 * 1024;
+
+// Marks the dense table entries leading to a state where patterns end
+constexpr std::uint32_t accept_bit = 0x80000000u;
+
+multi_searcher::multi_searcher (const std::vector<std::string>& patterns, bool ignore_case)
+    : multi_searcher{
+          std::vector<std::string_view> (patterns.begin(), patterns.end()), ignore_case
+      } {}
+
+multi_searcher::multi_searcher (const std::vector<std::string_view>& patterns, bool ignore_case) {
+    // Input classes: one per byte used in the patterns, 0 for all the others.
+    // Ignoring the case, both cases of a letter share the class.
+    auto fold = [ignore_case] (unsigned char c) {
+        return ignore_case ? gpw::simd::fold_lower (c) : c;
+    };
+
+    std::array<bool, 256> used{};
+    for (const auto& pat : patterns)
+        for (const char c : pat)
+            used[fold (static_cast<unsigned char> (c))] = true;
+    for (std::size_t b = 0; b < 256; ++b)
+        if (used[b]) _class[b] = static_cast<std::uint16_t> (_count_classes++);
+    for (std::size_t b = 0; b < 256; ++b)
+        _class[b] = _class[fold (static_cast<unsigned char> (b))];
+
+    // Trie
+    using edges_t = std::vector<std::pair<std::uint16_t, state_t>>;
+    std::vector<edges_t>                    trie (1);
+    std::vector<std::vector<std::uint32_t>> ends (1);
+
+    auto child = [&trie] (state_t s, std::uint16_t c) -> state_t {
+        for (const auto& [label, target] : trie[s])
+            if (label == c) return target;
+        return 0;
+    };
+
+    _lengths.reserve (patterns.size());
+    for (std::size_t id = 0; id < patterns.size(); ++id) {
+        _lengths.push_back (patterns[id].length());
+        if (patterns[id].empty()) continue;
+
+        state_t s = 0;
+        for (const char ch : patterns[id]) {
+            const auto c    = _class[static_cast<unsigned char> (ch)];
+            state_t    next = child (s, c);
+            if (next == 0) {
+                next = static_cast<state_t> (trie.size());
+                trie[s].emplace_back (c, next);
+                trie.emplace_back();
+                ends.emplace_back();
+            }
+            s = next;
+        }
+        ends[s].push_back (static_cast<std::uint32_t> (id));
+    }
+
+    // Renumber the states in breadth first order, so that the shallow states,
+    // which are visited most often, come first.
+    const std::size_t    count = trie.size();
+    std::vector<state_t> order{0};
+    std::vector<state_t> rank (count, 0);
+    order.reserve (count);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        auto& edges = trie[order[i]];
+        std::sort (edges.begin(), edges.end());
+        for (const auto& [label, target] : edges) {
+            rank[target] = static_cast<state_t> (order.size());
+            order.push_back (target);
+        }
+    }
+
+    std::vector<edges_t>                    bfs_trie (count);
+    std::vector<std::vector<std::uint32_t>> bfs_ends (count);
+    for (std::size_t old = 0; old < count; ++old) {
+        for (const auto& [label, target] : trie[old])
+            bfs_trie[rank[old]].emplace_back (label, rank[target]);
+        bfs_ends[rank[old]] = std::move (ends[old]);
+    }
+    trie = std::move (bfs_trie);
+    ends = std::move (bfs_ends);
+
+    // Failure and dictionary suffix links.  A failure target is shallower than
+    // its state, hence already processed.
+    _fail.assign (count, 0);
+    _dict.assign (count, 0);
+    auto go = [&] (state_t s, std::uint16_t c) {
+        for (;;) {
+            if (const auto next = child (s, c)) return next;
+            if (s == 0) return state_t{0};
+            s = _fail[s];
+        }
+    };
+    for (state_t s = 0; s < count; ++s) {
+        for (const auto& [label, target] : trie[s]) {
+            const state_t f = (s == 0) ? 0 : go (_fail[s], label);
+            _fail[target]   = f;
+            _dict[target]   = ends[f].empty() ? _dict[f] : f;
+        }
+    }
+
+    _out_begin.reserve (count + 1);
+    _accepting.reserve (count);
+    for (state_t s = 0; s < count; ++s) {
+        _out_begin.push_back (static_cast<std::uint32_t> (_out_ids.size()));
+        _out_ids.insert (_out_ids.end(), ends[s].begin(), ends[s].end());
+        _accepting.push_back (!ends[s].empty() || _dict[s] != 0);
+    }
+    _out_begin.push_back (static_cast<std::uint32_t> (_out_ids.size()));
+
+    // Dense rows complete the transitions through the failure links; the
+    // failure target of a state is shallower, so its row is already filled.
+    _count_dense = std::min (
+        count, std::max<std::size_t> (1, dense_table_bytes / (_count_classes * sizeof (state_t)))
+    );
+    if (_count_dense * _count_classes + count >= accept_bit)
+        throw std::runtime_error{"Too many patterns for the automaton"};
+
+    std::vector<state_t> rows (_count_dense * _count_classes, 0);
+    for (state_t s = 0; s < _count_dense; ++s) {
+        state_t* row = &rows[s * _count_classes];
+        if (s != 0) {
+            const state_t* fail_row = &rows[_fail[s] * _count_classes];
+            std::copy (fail_row, fail_row + _count_classes, row);
+        }
+        for (const auto& [label, target] : trie[s])
+            row[label] = target;
+    }
+    _dense.resize (rows.size());
+    std::transform (rows.begin(), rows.end(), _dense.begin(), [this] (state_t s) {
+        return _entry (s);
+    });
+
+    _edge_begin.reserve (count + 1);
+    for (state_t s = 0; s < count; ++s) {
+        _edge_begin.push_back (static_cast<std::uint32_t> (_edge_class.size()));
+        if (s < _count_dense) continue;
+        for (const auto& [label, target] : trie[s]) {
+            _edge_class.push_back (label);
+            _edge_target.push_back (target);
+        }
+    }
+    _edge_begin.push_back (static_cast<std::uint32_t> (_edge_class.size()));
+}
+
+// States are coded by the offset of their row in the dense table; the other
+// states follow the table.
+std::uint32_t
+multi_searcher::_code (state_t s) const {
+    return (s < _count_dense) ? s * _count_classes
+                              : _count_dense * _count_classes + (s - _count_dense);
+}
+
+multi_searcher::state_t
+multi_searcher::_state (std::uint32_t code) const {
+    const auto dense_end = _count_dense * _count_classes;
+    return (code < dense_end) ? code / _count_classes : code - dense_end + _count_dense;
+}
+
+std::uint32_t
+multi_searcher::_entry (state_t s) const {
+    return _code (s) | (_accepting[s] ? accept_bit : 0);
+}
+
+multi_searcher::state_t
+multi_searcher::_next (state_t s, std::uint16_t c) const {
+    while (s >= _count_dense) {
+        const auto end = _edge_begin[s + 1];
+        for (auto e = _edge_begin[s]; e < end && _edge_class[e] <= c; ++e)
+            if (_edge_class[e] == c) return _edge_target[e];
+        s = _fail[s];
+    }
+    return _state (_dense[s * _count_classes + c] & ~accept_bit);
+}
+
+// Runs the automaton over txt from the state s, calling on_end with the state
+// and the offset of every byte where a pattern ends.  Returns the final state.
+template <typename F>
+multi_searcher::state_t
+multi_searcher::_scan (std::string_view txt, state_t s, F&& on_end) const {
+    // The row offsets of dense states are followed directly, which keeps the
+    // loop carried dependency down to one load.
+    const std::uint32_t dense_end = _count_dense * _count_classes;
+    const std::size_t   n         = txt.length();
+
+    std::uint32_t code = _code (s);
+    for (std::size_t i = 0; i < n; ++i) {
+        const auto          c = _class[static_cast<unsigned char> (txt[i])];
+        const std::uint32_t e =
+            (code < dense_end) ? _dense[code + c] : _entry (_next (_state (code), c));
+        code = e & ~accept_bit;
+        if (e & accept_bit) on_end (_state (code), i);
+    }
+    return _state (code);
+}
+
+// Reports the patterns ending at the offset end in the state s, longest first.
+template <typename F>
+void
+multi_searcher::_report (state_t s, std::size_t end, F&& on_match) const {
+    for (; s != 0; s = _dict[s]) {
+        for (auto o = _out_begin[s]; o < _out_begin[s + 1]; ++o) {
+            const auto id = _out_ids[o];
+            on_match (match{id, end + 1 - _lengths[id]});
+        }
+    }
+}
+
+std::size_t
+multi_searcher::find_all (std::string_view txt, std::vector<match>& out) const {
+    out.clear();
+    _scan (txt, 0, [this, &out] (state_t s, std::size_t end) {
+        _report (s, end, [&out] (const match& m) { out.push_back (m); });
+    });
+    return out.size();
+}
+
+std::size_t
+multi_searcher::find_all (std::string_view chunk, cursor& cur, std::vector<match>& out) const {
+    out.clear();
+    const std::size_t offset = cur.offset;
+    cur.state = _scan (chunk, cur.state, [this, &out, offset] (state_t s, std::size_t end) {
+        _report (s, offset + end, [&out] (const match& m) { out.push_back (m); });
+    });
+    cur.offset += chunk.length();
+    return out.size();
+}
+
+std::size_t
+multi_searcher::count (std::string_view txt) const {
+    std::size_t res = 0;
+    _scan (txt, 0, [this, &res] (state_t s, std::size_t end) {
+        _report (s, end, [&res] (const match&) { ++res; });
+    });
+    return res;
+}
+
+std::size_t
+stream_searcher::feed (std::string_view chunk, std::vector<std::size_t>& out) {
+    out.clear();
+
+    const std::size_t m = _s->pattern().length();
+    if (m == 0) {
+        _offset += chunk.length();
+        return 0;
+    }
+
+    // Matches starting in the tail end within the first m - 1 bytes of chunk.
+    if (!_tail.empty()) {
+        _window.assign (_tail);
+        _window.append (chunk.substr (0, m - 1));
+        const std::size_t base = _offset - _tail.length();
+        for (auto pos = _s->find_first (_window); pos < _tail.length();
+             pos      = _s->find_first (_window, pos + 1))
+            out.push_back (base + pos);
+    }
+
+    _s->find_all (chunk, _found);
+    for (const auto pos : _found)
+        out.push_back (_offset + pos);
+
+    // Keep the last m - 1 bytes of the stream
+    if (chunk.length() >= m - 1) {
+        _tail.assign (chunk.substr (chunk.length() - (m - 1)));
+    } else {
+        _tail.append (chunk);
+        if (_tail.length() > m - 1) _tail.erase (0, _tail.length() - (m - 1));
+    }
+    _offset += chunk.length();
+    return out.size();
+}
+
+namespace {
+
+// Reads the file in chunks of chunk_size bytes, passing each to on_chunk.
+template <typename F>
+void
+read_chunks (const std::filesystem::path& path, std::size_t chunk_size, F&& on_chunk) {
+    std::ifstream in (path, std::ios::binary);
+    if (!in) throw std::runtime_error{"Failed to open the file to search"};
+
+    std::unique_ptr<char[]> buf (new char[chunk_size]);
+    while (in) {
+        in.read (buf.get(), chunk_size);
+        const auto len = static_cast<std::size_t> (in.gcount());
+        if (len == 0) break;
+        on_chunk (std::string_view{buf.get(), len});
+    }
+    if (in.bad()) throw std::runtime_error{"Failed to read the file to search"};
+}
+
+}  // namespace
+
+std::size_t
+search_file (
+    const std::filesystem::path& path,
+    const searcher&              s,
+    std::vector<std::size_t>&    out,
+    std::size_t                  chunk_size
+) {
+    out.clear();
+    stream_searcher          ss{s};
+    std::vector<std::size_t> found;
+    read_chunks (path, std::max (chunk_size, s.pattern().length()), [&] (std::string_view chunk) {
+        ss.feed (chunk, found);
+        out.insert (out.end(), found.begin(), found.end());
+    });
+    return out.size();
+}
+
+std::size_t
+search_file (
+    const std::filesystem::path&        path,
+    const multi_searcher&               ms,
+    std::vector<multi_searcher::match>& out,
+    std::size_t                         chunk_size
+) {
+    out.clear();
+    multi_searcher::cursor             cur;
+    std::vector<multi_searcher::match> found;
+    read_chunks (path, std::max<std::size_t> (chunk_size, 1), [&] (std::string_view chunk) {
+        ms.find_all (chunk, cur, found);
+        out.insert (out.end(), found.begin(), found.end());
+    });
+    return out.size();
+}
+
+std::size_t
+find_all_parallel (
+    const searcher&                 s,
+    std::string_view                txt,
+    std::vector<std::size_t>&       out,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     chunk_size
+) {
+    out.clear();
+
+    const std::size_t m = s.pattern().length();
+    const std::size_t n = txt.length();
+    if (m == 0 || m > n) return 0;
+
+    chunk_size              = std::max<std::size_t> (chunk_size, 1);
+    const std::size_t count = (n - m) / chunk_size + 1;  // Chunks of match starts
+    if (count == 1) return s.find_all (txt, out);
+
+    std::vector<std::vector<std::size_t>> found (count);
+    gpw::concurrency::first_exception     error;
+    gpw::concurrency::latch               done (count);
+    for (std::size_t i = 0; i < count; ++i) {
+        pool.queue_job ([&, i] {
+            try {
+                const std::size_t begin = i * chunk_size;
+                s.find_all (txt.substr (begin, chunk_size + m - 1), found[i]);
+                for (auto& pos : found[i])
+                    pos += begin;
+            } catch (...) {
+                error.capture();
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    error.rethrow();
+
+    std::size_t total = 0;
+    for (const auto& f : found)
+        total += f.size();
+    out.reserve (total);
+    for (const auto& f : found)
+        out.insert (out.end(), f.begin(), f.end());
+    return out.size();
+}
+
+}  // namespace gpw::str
@@ -0,0 +1,368 @@
+// -----------------------------------------------------------------------------
+// String search
+// -----------------------------------------------------------------------------
+#ifndef gpw_search_h
+#define gpw_search_h
+
+#include "core/concurrency.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gpw::str {
+
+// Precompiled single pattern searcher
+//
+// The tables of the selected algorithm are built once, so the same pattern
+// can be searched in many texts without any setup or allocation per call.
+// All functions are const and may be called concurrently.
+//
+// With ignore_case, ASCII letters match regardless of their case.  The text is
+// folded while it is matched (32 or 16 bytes at a time by the vectorized
+// filter), so it need not be converted first.
+//
+//   searcher s{"ERROR"};
+//   for (const auto& line : lines)
+//     if (s.find_first (line) != std::string_view::npos) ...
+//
+//   for (auto pos : s.matches (txt)) ...
+class searcher {
+  public:
+    enum class algorithm {
+        automatic,   // Chosen from the length and the alphabet of the pattern
+        vectorized,  // SIMD first/last byte filter, falling back to KMP
+        kmp,         // Knuth-Morris-Pratt
+        horspool,    // Boyer-Moore-Horspool
+        two_way      // Crochemore-Perrin Two-Way
+    };
+
+    class match_iterator;
+    class match_range;
+
+    explicit searcher (
+        std::string_view pat, algorithm algo = algorithm::automatic, bool ignore_case = false
+    );
+
+    // Position of the first match at or after pos, or npos
+    std::size_t
+    find_first (std::string_view txt, std::size_t pos = 0) const;
+
+    // Stores the positions of all (possibly overlapping) matches in out,
+    // replacing its contents but reusing its capacity.  Returns the count.
+    std::size_t
+    find_all (std::string_view txt, std::vector<std::size_t>& out) const;
+
+    std::size_t
+    count (std::string_view txt) const;
+
+    // Lazily enumerates the positions of the matches
+    match_range
+    matches (std::string_view txt) const;
+
+    // The pattern, folded to lower case if the case is ignored
+    std::string_view
+    pattern () const {
+        return _pat;
+    }
+
+    bool
+    ignore_case () const {
+        return _ignore_case;
+    }
+
+    algorithm
+    algo () const {
+        return _algo;
+    }
+
+  private:
+    template <typename F>
+    void
+    _for_each (std::string_view txt, std::size_t pos, F&& on_match) const;
+
+    template <bool IgnoreCase, typename F>
+    void
+    _search (std::string_view txt, std::size_t pos, F&& on_match) const;
+
+    std::string _pat;
+    algorithm   _algo;
+    bool        _ignore_case;
+
+    // KMP failure table (vectorized, kmp)
+    std::vector<int> _llps;
+
+    // Bad character shifts (horspool)
+    std::array<std::size_t, 256> _shift{};
+
+    // Critical factorization (two_way)
+    std::ptrdiff_t _ell      = -1;
+    std::size_t    _period   = 1;
+    bool           _periodic = false;
+};
+
+class searcher::match_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = std::size_t;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const std::size_t*;
+    using reference         = const std::size_t&;
+
+    match_iterator () = default;
+    match_iterator (const searcher* s, std::string_view txt, std::size_t pos)
+        : _s{s}, _txt{txt}, _pos{pos} {}
+
+    reference
+    operator* () const {
+        return _pos;
+    }
+
+    match_iterator&
+    operator++ () {
+        _pos = _s->find_first (_txt, _pos + 1);
+        return *this;
+    }
+
+    match_iterator
+    operator++ (int) {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    bool
+    operator== (const match_iterator& other) const {
+        return _pos == other._pos;
+    }
+
+    bool
+    operator!= (const match_iterator& other) const {
+        return _pos != other._pos;
+    }
+
+  private:
+    const searcher*  _s = nullptr;
+    std::string_view _txt;
+    std::size_t      _pos = std::string_view::npos;
+};
+
+class searcher::match_range {
+  public:
+    match_range (const searcher* s, std::string_view txt) : _s{s}, _txt{txt} {}
+
+    match_iterator
+    begin () const {
+        return {_s, _txt, _s->find_first (_txt)};
+    }
+
+    match_iterator
+    end () const {
+        return {};
+    }
+
+  private:
+    const searcher*  _s;
+    std::string_view _txt;
+};
+
+inline searcher::match_range
+searcher::matches (std::string_view txt) const {
+    return {this, txt};
+}
+
+// Multiple pattern searcher (Aho-Corasick)
+//
+// The patterns are compiled once into an automaton which finds all the
+// occurrences of all the patterns in a single pass over the text.  Bytes that
+// do not occur in any pattern share one input class, shallow (hot) states have
+// dense transition rows, and deeper states keep sorted edge lists with failure
+// links, which keeps the automaton small enough to stay in cache.  With
+// ignore_case, both cases of an ASCII letter map to the same input class, so
+// case insensitive matching costs nothing extra.
+//
+//   multi_searcher ms{std::vector<std::string_view>{"error", "fatal", "panic"}};
+//   ms.find_all (line, matches);  // (pattern id, offset) pairs
+class multi_searcher {
+  public:
+    struct match {
+        std::size_t id;   // Index of the pattern
+        std::size_t pos;  // Offset of the first byte of the match
+
+        bool
+        operator== (const match& other) const {
+            return id == other.id && pos == other.pos;
+        }
+    };
+
+    // Position in a text delivered in chunks: the state of the automaton and
+    // the number of bytes consumed so far
+    struct cursor {
+        std::uint32_t state  = 0;
+        std::size_t   offset = 0;
+    };
+
+    explicit multi_searcher (
+        const std::vector<std::string_view>& patterns, bool ignore_case = false
+    );
+    explicit multi_searcher (const std::vector<std::string>& patterns, bool ignore_case = false);
+
+    // Stores all the matches in out, ordered by their end offsets, replacing
+    // its contents but reusing its capacity.  Returns the count.
+    std::size_t
+    find_all (std::string_view txt, std::vector<match>& out) const;
+
+    std::size_t
+    count (std::string_view txt) const;
+
+    // Searches the next chunk of a text, carrying the automaton state in cur,
+    // so matches spanning chunk boundaries are found too.  The offsets of the
+    // matches in out are absolute.  Returns the count.
+    std::size_t
+    find_all (std::string_view chunk, cursor& cur, std::vector<match>& out) const;
+
+    std::size_t
+    size () const {
+        return _lengths.size();
+    }
+
+    std::size_t
+    count_states () const {
+        return _fail.size();
+    }
+
+  private:
+    using state_t = std::uint32_t;
+
+    std::uint32_t
+    _code (state_t s) const;
+
+    state_t
+    _state (std::uint32_t code) const;
+
+    std::uint32_t
+    _entry (state_t s) const;
+
+    state_t
+    _next (state_t s, std::uint16_t c) const;
+
+    template <typename F>
+    state_t
+    _scan (std::string_view txt, state_t s, F&& on_end) const;
+
+    template <typename F>
+    void
+    _report (state_t s, std::size_t end, F&& on_match) const;
+
+    std::vector<std::size_t> _lengths;  // Pattern lengths
+
+    std::array<std::uint16_t, 256> _class{};  // Input class of each byte
+    std::uint32_t                  _count_classes = 1;
+
+    // Transitions of the states [0, _count_dense) in row-major order.  An entry
+    // holds the code of the target state (see _code), with the top bit set if
+    // a pattern ends there.
+    std::uint32_t              _count_dense = 0;
+    std::vector<std::uint32_t> _dense;
+
+    // Edges of the other states: [_edge_begin[s], _edge_begin[s + 1])
+    std::vector<std::uint32_t> _edge_begin;
+    std::vector<std::uint16_t> _edge_class;
+    std::vector<state_t>       _edge_target;
+    std::vector<state_t>       _fail;
+
+    // Patterns ending at a state: [_out_begin[s], _out_begin[s + 1]), and the
+    // closest state on the failure chain with patterns of its own (0 if none)
+    std::vector<std::uint32_t> _out_begin;
+    std::vector<std::uint32_t> _out_ids;
+    std::vector<state_t>       _dict;
+    std::vector<std::uint8_t>  _accepting;
+};
+
+// Streaming search
+//
+// Finds the matches of a searcher in a text delivered in successive chunks,
+// including the matches spanning chunk boundaries.  Only the last (pattern
+// length - 1) bytes are retained between chunks.  The searcher must outlive
+// the stream_searcher.
+//
+//   stream_searcher ss{s};
+//   while (read (buf))
+//     ss.feed (buf, offsets);  // absolute offsets
+class stream_searcher {
+  public:
+    explicit stream_searcher (const searcher& s) : _s{&s} {}
+
+    // Stores the absolute positions of the matches ending in chunk in out,
+    // replacing its contents.  Returns the count.
+    std::size_t
+    feed (std::string_view chunk, std::vector<std::size_t>& out);
+
+    // Number of bytes fed so far
+    std::size_t
+    offset () const {
+        return _offset;
+    }
+
+    void
+    reset () {
+        _tail.clear();
+        _offset = 0;
+    }
+
+  private:
+    const searcher*          _s;
+    std::string              _tail;    // The last bytes of the previous chunks
+    std::string              _window;  // _tail and the head of the next chunk
+    std::vector<std::size_t> _found;
+    std::size_t              _offset = 0;
+};
+
+constexpr std::size_t default_chunk_size = 1 << 20;
+
+// Searches a file with sequential reads of chunk_size bytes, storing the
+// absolute offsets of the matches in out.  Memory use is bounded by the chunk
+// size.  Throws runtime_error if the file cannot be read.
+std::size_t
+search_file (
+    const std::filesystem::path& path,
+    const searcher&              s,
+    std::vector<std::size_t>&    out,
+    std::size_t                  chunk_size = default_chunk_size
+);
+
+std::size_t
+search_file (
+    const std::filesystem::path&        path,
+    const multi_searcher&               ms,
+    std::vector<multi_searcher::match>& out,
+    std::size_t                         chunk_size = default_chunk_size
+);
+
+constexpr std::size_t default_parallel_chunk_size = 8 << 20;
+
+// Parallel search
+//
+// Splits txt into chunks of chunk_size bytes, extended by (pattern length - 1)
+// bytes so that matches across the splits are found exactly once, searches
+// them as jobs on the pool and stores the matches in order in out.  Returns
+// the count.  The pool must have been started, and this function must not be
+// called from one of its jobs.  If a job throws (e.g. bad_alloc), the first
+// exception is rethrown once all the jobs have finished.
+std::size_t
+find_all_parallel (
+    const searcher&                 s,
+    std::string_view                txt,
+    std::vector<std::size_t>&       out,
+    gpw::concurrency::thread_pool& pool,
+    std::size_t                     chunk_size = default_parallel_chunk_size
+);
+
+}  // namespace gpw::str
+
+#endif
@@ -0,0 +1,119 @@
+// -----------------------------------------------------------------------------
+// SIMD support
+//
+// Helpers shared by the vectorized kernels of the toolbox.  Kernels are written
+// with intrinsics and compiled for a specific instruction set through the target
+// attribute, so the library itself is built without special compiler flags and
+// the best kernel is selected at run time.
+// -----------------------------------------------------------------------------
+#ifndef gpw_simd_h
+#define gpw_simd_h
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GPW_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GPW_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#else
+#define GPW_TARGET_AVX2
+#endif
+
+namespace gpw::simd {
+
+// True if the processor running the program supports AVX2.  SSE2 is always
+// available on x86-64, so it needs no check.
+inline bool
+has_avx2 () {
+#if defined(GPW_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+    static const bool supported = __builtin_cpu_supports ("avx2");
+    return supported;
+#elif defined(GPW_SIMD_X86) && defined(_MSC_VER)
+    static const bool supported = [] {
+        int info[4];
+        __cpuidex (info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+// Index of the lowest set bit.  The argument must not be zero.
+inline int
+count_trailing_zeros (std::uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz (mask);
+#elif defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward (&idx, mask);
+    return static_cast<int> (idx);
+#else
+    int n = 0;
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+inline int
+count_trailing_zeros (std::uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll (mask);
+#elif defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward64 (&idx, mask);
+    return static_cast<int> (idx);
+#else
+    int n = 0;
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// ASCII case folding of a single byte
+inline unsigned char
+fold_lower (unsigned char c) {
+    return (static_cast<unsigned> (c - 'A') < 26u) ? c | 0x20 : c;
+}
+
+inline unsigned char
+fold_upper (unsigned char c) {
+    return (static_cast<unsigned> (c - 'a') < 26u) ? c & ~0x20 : c;
+}
+
+#if defined(GPW_SIMD_X86)
+// Flips the case of the bytes in [first, first + 26), i.e. folds to lower case
+// with first = 'A' and to upper case with first = 'a'.  The letters are found
+// with one signed comparison: adding (128 - first) maps them to [-128, -102).
+inline __m128i
+fold_sse2 (__m128i v, char first) {
+    const __m128i shifted = _mm_add_epi8 (v, _mm_set1_epi8 (static_cast<char> (128 - first)));
+    const __m128i letters = _mm_cmplt_epi8 (shifted, _mm_set1_epi8 (-128 + 26));
+    return _mm_xor_si128 (v, _mm_and_si128 (letters, _mm_set1_epi8 (0x20)));
+}
+
+GPW_TARGET_AVX2 inline __m256i
+fold_avx2 (__m256i v, char first) {
+    const __m256i shifted =
+        _mm256_add_epi8 (v, _mm256_set1_epi8 (static_cast<char> (128 - first)));
+    const __m256i letters = _mm256_cmpgt_epi8 (_mm256_set1_epi8 (-128 + 26), shifted);
+    return _mm256_xor_si256 (v, _mm256_and_si256 (letters, _mm256_set1_epi8 (0x20)));
+}
+#endif
+
+}  // namespace gpw::simd
+
+#endif
@@ -0,0 +1,116 @@
+#include "core/split.h"
+#include "core/simd.h"
+
+#include <algorithm>
+
+namespace gpw::str {
+
+namespace {
+
+// Bit i of the result is set if s[block + i] is c, for the bytes of the block
+// [block, block + 64) inside [0, n).
+using mask_fn = std::uint64_t (*) (const char* s, std::size_t n, std::size_t block, char c);
+
+std::uint64_t
+delim_mask_scalar (const char* s, std::size_t n, std::size_t block, char c) {
+    std::uint64_t     mask = 0;
+    const std::size_t end  = std::min (n, block + 64);
+    for (std::size_t i = block; i < end; ++i)
+        if (s[i] == c) mask |= std::uint64_t{1} << (i - block);
+    return mask;
+}
+
+#if defined(GPW_SIMD_X86)
+std::uint64_t
+delim_mask_sse2 (const char* s, std::size_t n, std::size_t block, char c) {
+    if (block + 64 > n) return delim_mask_scalar (s, n, block, c);
+
+    const __m128i needle = _mm_set1_epi8 (c);
+    std::uint64_t mask   = 0;
+    for (int k = 0; k < 4; ++k) {
+        const __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + block + 16 * k));
+        const auto    m = _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, needle));
+        mask |= std::uint64_t{static_cast<std::uint32_t> (m)} << (16 * k);
+    }
+    return mask;
+}
+
+GPW_TARGET_AVX2 std::uint64_t
+delim_mask_avx2 (const char* s, std::size_t n, std::size_t block, char c) {
+    if (block + 64 > n) return delim_mask_scalar (s, n, block, c);
+
+    const __m256i needle = _mm256_set1_epi8 (c);
+    const __m256i lo     = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + block));
+    const __m256i hi     = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + block + 32));
+    const auto    m_lo =
+        static_cast<std::uint32_t> (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (lo, needle)));
+    const auto m_hi =
+        static_cast<std::uint32_t> (_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (hi, needle)));
+    return (std::uint64_t{m_hi} << 32) | m_lo;
+}
+#endif
+
+std::uint64_t
+delim_mask (const char* s, std::size_t n, std::size_t block, char c) {
+#if defined(GPW_SIMD_X86)
+    static const mask_fn kernel = gpw::simd::has_avx2() ? delim_mask_avx2 : delim_mask_sse2;
+#else
+    static const mask_fn kernel = delim_mask_scalar;
+#endif
+    return kernel (s, n, block, c);
+}
+
+}  // namespace
+
+std::size_t
+split_view::_find (std::size_t pos, std::size_t& block, std::uint64_t& mask) const {
+    const std::size_t n = _str.length();
+    if (pos >= n) return std::string_view::npos;
+
+    switch (_kind) {
+    case kind::any_of: return _delims.find_first_of (_str, pos);
+    case kind::substring:
+        return _sep.empty() ? std::string_view::npos : find_first (_sep, _str, pos);
+    default: break;
+    }
+
+    // Blocks are aligned to 64 bytes from the beginning of the string.
+    const std::size_t start = pos & ~std::size_t{63};
+    if (start != block) {
+        block = start;
+        mask  = delim_mask (_str.data(), n, block, _delim);
+    }
+    mask &= ~std::uint64_t{0} << (pos - block);
+
+    while (mask == 0) {
+        block += 64;
+        if (block >= n) return std::string_view::npos;
+        mask = delim_mask (_str.data(), n, block, _delim);
+    }
+    return block + gpw::simd::count_trailing_zeros (mask);
+}
+
+split_view::iterator&
+split_view::iterator::operator++ () {
+    for (;;) {
+        if (_next == std::string_view::npos) {
+            _at_end = true;
+            return *this;
+        }
+
+        const std::string_view str   = _view->_str;
+        const std::size_t      delim = _view->_find (_next, _block, _mask);
+        if (delim == std::string_view::npos) {
+            _token = str.substr (_next);
+            _next  = std::string_view::npos;
+        } else {
+            _token = str.substr (_next, delim - _next);
+            _next  = delim + _view->_delim_length();
+        }
+
+        if (_view->_opts & trim_tokens) _token = trim (_token);
+        if (!(_view->_opts & skip_empty) || !_token.empty()) return *this;
+    }
+}
+
+}  // namespace gpw::str
@@ -0,0 +1,161 @@
+// -----------------------------------------------------------------------------
+// String splitting
+// -----------------------------------------------------------------------------
+#ifndef gpw_split_h
+#define gpw_split_h
+
+#include "core/str.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+namespace gpw::str {
+
+// Lazy split view
+//
+// Splits a string at a delimiter (a byte, any byte of a set, or a substring)
+// and yields the tokens as string_views into the original string, without any
+// allocation.  Like string_view, the view does not own the string (nor the
+// substring delimiter).
+//
+// "a,b,,c" split at ',' yields "a", "b", "", "c"; skip_empty drops the empty
+// token and trim_tokens trims whitespace off each token before that.
+//
+//   for (auto field : split (line, '\t'))
+//     ...
+//
+// Single byte delimiters are located with a SIMD scanner which computes the
+// delimiter positions of 64 bytes at a time, so short fields cost a bit test
+// rather than a call to memchr each.
+class split_view {
+  public:
+    enum options : unsigned { none = 0, skip_empty = 1, trim_tokens = 2 };
+
+    class iterator;
+
+    split_view (std::string_view str, char delim, unsigned opts = none)
+        : _str{str}, _kind{kind::single}, _delim{delim}, _opts{opts} {}
+    split_view (std::string_view str, const byte_class& delims, unsigned opts = none)
+        : _str{str}, _kind{kind::any_of}, _delims{delims}, _opts{opts} {}
+    split_view (std::string_view str, std::string_view delim, unsigned opts = none)
+        : _str{str}, _kind{kind::substring}, _sep{delim}, _opts{opts} {}
+
+    iterator
+    begin () const;
+
+    iterator
+    end () const;
+
+  private:
+    enum class kind { single, any_of, substring };
+
+    // Position of the first delimiter at or after pos, or npos.  block and mask
+    // cache the delimiter bits of the current 64 byte block.
+    std::size_t
+    _find (std::size_t pos, std::size_t& block, std::uint64_t& mask) const;
+
+    std::size_t
+    _delim_length () const {
+        return (_kind == kind::substring) ? _sep.length() : 1;
+    }
+
+    std::string_view _str;
+    kind             _kind;
+    char             _delim = '\0';
+    byte_class       _delims{""};
+    std::string_view _sep;
+    unsigned         _opts;
+};
+
+class split_view::iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = std::string_view;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const std::string_view*;
+    using reference         = const std::string_view&;
+
+    iterator () = default;
+
+    reference
+    operator* () const {
+        return _token;
+    }
+
+    pointer
+    operator->() const {
+        return &_token;
+    }
+
+    iterator&
+    operator++ ();
+
+    iterator
+    operator++ (int) {
+        auto tmp = *this;
+        ++*this;
+        return tmp;
+    }
+
+    bool
+    operator== (const iterator& other) const {
+        return _at_end == other._at_end && (_at_end || _next == other._next);
+    }
+
+    bool
+    operator!= (const iterator& other) const {
+        return !(*this == other);
+    }
+
+  private:
+    friend class split_view;
+
+    explicit iterator (const split_view* view) : _view{view}, _at_end{false} {
+        ++*this;
+    }
+
+    const split_view* _view = nullptr;
+    std::string_view  _token;
+    std::size_t       _next   = 0;  // Start of the next token, npos after the last
+    bool              _at_end = true;
+
+    std::size_t   _block = std::string_view::npos;
+    std::uint64_t _mask  = 0;
+};
+
+inline split_view::iterator
+split_view::begin () const {
+    return iterator{this};
+}
+
+inline split_view::iterator
+split_view::end () const {
+    return {};
+}
+
+inline split_view
+split (std::string_view str, char delim, unsigned opts = split_view::none) {
+    return {str, delim, opts};
+}
+
+inline split_view
+split (std::string_view str, const byte_class& delims, unsigned opts = split_view::none) {
+    return {str, delims, opts};
+}
+
+inline split_view
+split (std::string_view str, std::string_view delim, unsigned opts = split_view::none) {
+    return {str, delim, opts};
+}
+
+// Splits at runs of whitespace, yielding the words
+inline split_view
+tokenize (std::string_view str, const byte_class& whitespace = default_whitespace) {
+    return {str, whitespace, split_view::skip_empty};
+}
+
+}  // namespace gpw::str
+
+#endif
@@ -1,29 +1,171 @@
 #include "core/str.h"
+#include "core/simd.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace gpw::str {
 
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-const string illegal_chars = "\\/:?\"<>|";
-#elif __APPLE__
-const std::string illegal_chars = "\\/:?\"<>|";
-#elif __linux__
-const std::string illegal_chars = "\\/";
+namespace {
+
+// Finds the first byte at or after pos whose membership in the set equals
+// member.  Returns n if there is none.  The SIMD kernels test the bytes against
+// each of the (at most 8) members of the set.
+using class_find_fn = std::size_t (*) (
+    const char* s, std::size_t n, std::size_t pos, const std::array<bool, 256>& table,
+    const char* members, std::size_t count, bool member
+);
+
+std::size_t
+class_find_scalar (
+    const char* s, std::size_t n, std::size_t pos, const std::array<bool, 256>& table,
+    const char*, std::size_t, bool member
+) {
+    for (; pos < n; ++pos)
+        if (table[static_cast<unsigned char> (s[pos])] == member) return pos;
+    return n;
+}
+
+#if defined(GPW_SIMD_X86)
+std::size_t
+class_find_sse2 (
+    const char* s, std::size_t n, std::size_t pos, const std::array<bool, 256>& table,
+    const char* members, std::size_t count, bool member
+) {
+    __m128i sets[8];
+    for (std::size_t k = 0; k < count; ++k)
+        sets[k] = _mm_set1_epi8 (members[k]);
+
+    for (; pos + 16 <= n; pos += 16) {
+        const __m128i v   = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + pos));
+        __m128i       acc = _mm_setzero_si128();
+        for (std::size_t k = 0; k < count; ++k)
+            acc = _mm_or_si128 (acc, _mm_cmpeq_epi8 (v, sets[k]));
+
+        std::uint32_t mask = _mm_movemask_epi8 (acc);
+        if (!member) mask = ~mask & 0xFFFFu;
+        if (mask != 0) return pos + gpw::simd::count_trailing_zeros (mask);
+    }
+    return class_find_scalar (s, n, pos, table, members, count, member);
+}
+
+GPW_TARGET_AVX2 std::size_t
+class_find_avx2 (
+    const char* s, std::size_t n, std::size_t pos, const std::array<bool, 256>& table,
+    const char* members, std::size_t count, bool member
+) {
+    __m256i sets[8];
+    for (std::size_t k = 0; k < count; ++k)
+        sets[k] = _mm256_set1_epi8 (members[k]);
+
+    for (; pos + 32 <= n; pos += 32) {
+        const __m256i v   = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + pos));
+        __m256i       acc = _mm256_setzero_si256();
+        for (std::size_t k = 0; k < count; ++k)
+            acc = _mm256_or_si256 (acc, _mm256_cmpeq_epi8 (v, sets[k]));
+
+        std::uint32_t mask = _mm256_movemask_epi8 (acc);
+        if (!member) mask = ~mask;
+        if (mask != 0) return pos + gpw::simd::count_trailing_zeros (mask);
+    }
+    return class_find_sse2 (s, n, pos, table, members, count, member);
+}
+#endif
+
+// Calls out with the pieces of the reduced string: the words, and fill between
+// them.
+template <typename Out>
+void
+for_each_reduced (
+    std::string_view str, std::string_view fill, const byte_class& whitespace, Out&& out
+) {
+    std::size_t begin = whitespace.find_first_not_of (str);
+    while (begin != std::string_view::npos) {
+        const std::size_t end = whitespace.find_first_of (str, begin);
+        if (end == std::string_view::npos) {
+            out (str.substr (begin));
+            return;
+        }
+        out (str.substr (begin, end - begin));
+
+        begin = whitespace.find_first_not_of (str, end);
+        if (begin != std::string_view::npos) out (fill);
+    }
+}
+
+// Reduces in place; fill must not be longer than one byte, so the output never
+// overtakes the input.
+std::string_view
+reduce_buffer (
+    char* data, std::size_t length, std::string_view fill, const byte_class& whitespace
+) {
+    char* dst = data;
+    for_each_reduced ({data, length}, fill, whitespace, [&dst] (std::string_view piece) {
+        std::memmove (dst, piece.data(), piece.length());
+        dst += piece.length();
+    });
+    return {data, static_cast<std::size_t> (dst - data)};
+}
+
+constexpr byte_class space{" \t\n\r\f\v"};
+
+template <typename String>
+void
+replace_illegal_chars (String& str) {
+    auto pos = illegal_filename_chars.find_first_of (str);
+    while (pos != std::string_view::npos) {
+        str[pos] = '-';
+        pos      = illegal_filename_chars.find_first_of (str, pos + 1);
+    }
+}
+
+}  // namespace
+
+std::size_t
+byte_class::_find (std::string_view str, std::size_t pos, bool member) const {
+    if (pos >= str.length()) return std::string_view::npos;
+
+#if defined(GPW_SIMD_X86)
+    static const class_find_fn kernel =
+        gpw::simd::has_avx2() ? class_find_avx2 : class_find_sse2;
 #else
-#error "Unknown compiler"
+    static const class_find_fn kernel = class_find_scalar;
 #endif
+    const auto find = (_count <= _members.size()) ? kernel : class_find_scalar;
+
+    const std::size_t found =
+        find (str.data(), str.length(), pos, _table, _members.data(), _count, member);
+    return (found < str.length()) ? found : std::string_view::npos;
+}
+
+std::size_t
+byte_class::find_first_of (std::string_view str, std::size_t pos) const {
+    return _find (str, pos, true);
+}
+
+std::size_t
+byte_class::find_first_not_of (std::string_view str, std::size_t pos) const {
+    return _find (str, pos, false);
+}
+
+std::size_t
+byte_class::find_last_not_of (std::string_view str) const {
+    for (std::size_t i = str.length(); i > 0; --i)
+        if (!contains (str[i - 1])) return i - 1;
+    return std::string_view::npos;
+}
 
 std::string_view
 ltrim (std::string_view str) {
-    const auto pos (str.find_first_not_of (" \t\n\r\f\v"));
+    const auto pos (space.find_first_not_of (str));
     str.remove_prefix (std::min (pos, str.length()));
     return str;
 }
 
 std::string_view
 rtrim (std::string_view str) {
-    const auto pos (str.find_last_not_of (" \t\n\r\f\v"));
+    const auto pos (space.find_last_not_of (str));
     str.remove_suffix (std::min (str.length() - pos - 1, str.length()));
     return str;
 }
@@ -37,61 +179,261 @@ trim (std::string_view str) {
 
 std::string
 trim (const std::string& str, const std::string& whitespace) {
-    const auto begin = str.find_first_not_of (whitespace);
-    if (begin == std::string::npos) return "";  // no content
+    return std::string{trim (std::string_view{str}, byte_class{whitespace})};
+}
 
-    const auto end   = str.find_last_not_of (whitespace);
-    const auto range = end - begin + 1;
+std::string_view
+trim (std::string_view str, const byte_class& whitespace) {
+    const auto begin = whitespace.find_first_not_of (str);
+    if (begin == std::string_view::npos) return str.substr (str.length());  // no content
 
-    return str.substr (begin, range);
+    const auto end = whitespace.find_last_not_of (str);
+    return str.substr (begin, end - begin + 1);
 }
 
 std::string
 reduce (const std::string& str, const std::string& fill, const std::string& whitespace) {
-    // trim first
-    auto result = trim (str, whitespace);
+    return reduce (std::string_view{str}, fill, byte_class{whitespace});
+}
+
+std::string
+reduce (std::string_view str, std::string_view fill, const byte_class& whitespace) {
+    std::string result;
+    result.reserve (str.length());
+    for_each_reduced (str, fill, whitespace, [&result] (std::string_view piece) {
+        result.append (piece);
+    });
+    return result;
+}
 
-    // replace sub ranges
-    auto begin_space = result.find_first_of (whitespace);
-    while (begin_space != std::string::npos) {
-        const auto end_space = result.find_first_not_of (whitespace, begin_space);
-        const auto range     = end_space - begin_space;
+std::pmr::string
+trim (std::string_view str, const byte_class& whitespace, std::pmr::memory_resource* mr) {
+    return std::pmr::string{trim (str, whitespace), mr};
+}
 
-        result.replace (begin_space, range, fill);
+std::pmr::string
+reduce (
+    std::string_view            str,
+    std::string_view            fill,
+    const byte_class&           whitespace,
+    std::pmr::memory_resource* mr
+) {
+    std::pmr::string result{mr};
+    result.reserve (str.length());
+    for_each_reduced (str, fill, whitespace, [&result] (std::string_view piece) {
+        result.append (piece);
+    });
+    return result;
+}
 
-        const auto new_begin = begin_space + fill.length();
-        begin_space          = result.find_first_of (whitespace, new_begin);
+void
+reduce_in_place (std::string& str, std::string_view fill, const byte_class& whitespace) {
+    if (fill.length() > 1) {
+        str = reduce (std::string_view{str}, fill, whitespace);
+        return;
     }
+    str.resize (reduce_buffer (str.data(), str.length(), fill, whitespace).length());
+}
 
-    return result;
+std::string_view
+reduce_in_place (char* data, std::size_t length, char fill, const byte_class& whitespace) {
+    return reduce_buffer (data, length, {&fill, 1}, whitespace);
 }
 
+namespace {
+
+using gpw::simd::fold_lower;
+using gpw::simd::fold_upper;
+
+// Converts n bytes from src to dst (which may be the same buffer).
+using convert_fn = void (*) (const char* src, char* dst, std::size_t n);
+
+template <bool Upper>
+void
+convert_scalar (const char* src, char* dst, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        const auto c = static_cast<unsigned char> (src[i]);
+        dst[i]       = static_cast<char> (Upper ? fold_upper (c) : fold_lower (c));
+    }
+}
+
+// Index of the first difference of a and b after folding to lower case, or n
+using mismatch_fn = std::size_t (*) (const char* a, const char* b, std::size_t n);
+
+std::size_t
+mismatch_scalar (const char* a, const char* b, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        if (fold_lower (static_cast<unsigned char> (a[i]))
+            != fold_lower (static_cast<unsigned char> (b[i])))
+            return i;
+    }
+    return n;
+}
+
+#if defined(GPW_SIMD_X86)
+using gpw::simd::fold_sse2;
+
+template <bool Upper>
+void
+convert_sse2 (const char* src, char* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (src + i));
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (dst + i), fold_sse2 (v, Upper ? 'a' : 'A'));
+    }
+    convert_scalar<Upper> (src + i, dst + i, n - i);
+}
+
+std::size_t
+mismatch_sse2 (const char* a, const char* b, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i va =
+            fold_sse2 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (a + i)), 'A');
+        const __m128i vb =
+            fold_sse2 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (b + i)), 'A');
+        const std::uint32_t eq = _mm_movemask_epi8 (_mm_cmpeq_epi8 (va, vb));
+        if (eq != 0xFFFF) return i + gpw::simd::count_trailing_zeros (~eq);
+    }
+    return i + mismatch_scalar (a + i, b + i, n - i);
+}
+
+using gpw::simd::fold_avx2;
+
+template <bool Upper>
+GPW_TARGET_AVX2 void
+convert_avx2 (const char* src, char* dst, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (src + i));
+        _mm256_storeu_si256 (
+            reinterpret_cast<__m256i*> (dst + i), fold_avx2 (v, Upper ? 'a' : 'A')
+        );
+    }
+    convert_sse2<Upper> (src + i, dst + i, n - i);
+}
+
+GPW_TARGET_AVX2 std::size_t
+mismatch_avx2 (const char* a, const char* b, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i va =
+            fold_avx2 (_mm256_loadu_si256 (reinterpret_cast<const __m256i*> (a + i)), 'A');
+        const __m256i vb =
+            fold_avx2 (_mm256_loadu_si256 (reinterpret_cast<const __m256i*> (b + i)), 'A');
+        const std::uint32_t eq = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (va, vb));
+        if (eq != 0xFFFFFFFFu) return i + gpw::simd::count_trailing_zeros (~eq);
+    }
+    return i + mismatch_sse2 (a + i, b + i, n - i);
+}
+#endif
+
+template <bool Upper>
+void
+convert (const char* src, char* dst, std::size_t n) {
+#if defined(GPW_SIMD_X86)
+    static const convert_fn kernel =
+        gpw::simd::has_avx2() ? convert_avx2<Upper> : convert_sse2<Upper>;
+#else
+    static const convert_fn kernel = convert_scalar<Upper>;
+#endif
+    kernel (src, dst, n);
+}
+
+std::size_t
+mismatch_icase (const char* a, const char* b, std::size_t n) {
+#if defined(GPW_SIMD_X86)
+    static const mismatch_fn kernel = gpw::simd::has_avx2() ? mismatch_avx2 : mismatch_sse2;
+#else
+    static const mismatch_fn kernel = mismatch_scalar;
+#endif
+    return kernel (a, b, n);
+}
+
+}  // namespace
+
 std::string
 to_upper (std::string source_str) {
-    std::transform (source_str.begin(), source_str.end(), source_str.begin(), ::toupper);
+    to_upper_in_place (source_str);
     return source_str;
 }
 
 std::string
 to_lower (std::string source_str) {
-    std::transform (source_str.begin(), source_str.end(), source_str.begin(), ::tolower);
+    to_lower_in_place (source_str);
     return source_str;
 }
 
+void
+to_upper_in_place (std::string& str) {
+    convert<true> (str.data(), str.data(), str.length());
+}
+
+void
+to_lower_in_place (std::string& str) {
+    convert<false> (str.data(), str.data(), str.length());
+}
+
+char*
+to_upper (std::string_view src, char* dst) {
+    convert<true> (src.data(), dst, src.length());
+    return dst + src.length();
+}
+
+char*
+to_lower (std::string_view src, char* dst) {
+    convert<false> (src.data(), dst, src.length());
+    return dst + src.length();
+}
+
+std::pmr::string
+to_upper (std::string_view str, std::pmr::memory_resource* mr) {
+    std::pmr::string result (str.length(), '\0', mr);
+    to_upper (str, result.data());
+    return result;
+}
+
+std::pmr::string
+to_lower (std::string_view str, std::pmr::memory_resource* mr) {
+    std::pmr::string result (str.length(), '\0', mr);
+    to_lower (str, result.data());
+    return result;
+}
+
+int
+compare_icase (std::string_view str1, std::string_view str2) {
+    const std::size_t n = std::min (str1.length(), str2.length());
+    const std::size_t i = mismatch_icase (str1.data(), str2.data(), n);
+    if (i < n) {
+        return int{fold_lower (static_cast<unsigned char> (str1[i]))}
+             - int{fold_lower (static_cast<unsigned char> (str2[i]))};
+    }
+    if (str1.length() == str2.length()) return 0;
+    return str1.length() < str2.length() ? -1 : 1;
+}
+
+bool
+equals_icase (std::string_view str1, std::string_view str2) {
+    return str1.length() == str2.length()
+        && mismatch_icase (str1.data(), str2.data(), str1.length()) == str1.length();
+}
+
 std::string
 remove_illegal_char (std::string str) {
-    for (std::string::iterator it = str.begin(); it < str.end(); ++it) {
-        bool found = illegal_chars.find (*it) != std::string::npos;
-        if (found) {
-            *it = '-';
-        }
-    }
+    replace_illegal_chars (str);
     return str;
 }
 
+std::pmr::string
+remove_illegal_char (std::string_view str, std::pmr::memory_resource* mr) {
+    std::pmr::string result{str, mr};
+    replace_illegal_chars (result);
+    return result;
+}
+
 int
-compare (std::string str1, std::string str2) {
-    return to_lower (str1).compare (to_lower (str2));
+compare (std::string_view str1, std::string_view str2) {
+    return compare_icase (str1, str2);
 }
 
 std::string
@@ -125,9 +467,30 @@ format (const char* s) {
     return ss.str();
 }
 
+void
+append_json_string (std::string& out, std::string_view str) {
+    out += '"';
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char> (c) < 0x20) {
+            const char* const hex = "0123456789abcdef";
+            out += "\\u00";
+            out += hex[(c >> 4) & 0xf];
+            out += hex[c & 0xf];
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
 // KMP (Knuth-Morris-Pratt) search algorithm
 std::vector<int>
-llps (std::string& pat) {
+llps (std::string_view pat) {
+    if (pat.empty()) return {};
+
     // The length of longest proper prefix which is also a suffix for the previous index.
     int len = 0;
 
@@ -135,7 +498,7 @@ llps (std::string& pat) {
     // llps[0] is always 0
     _llps[0] = 0;
 
-    int i = 1;
+    std::size_t i = 1;
     while (i < pat.length()) {
         // If characters match, increment the size of lps
         if (pat[i] == pat[len]) {
@@ -161,42 +524,4 @@ llps (std::string& pat) {
     return _llps;
 }
 
-std::vector<int>
-search (std::string& pat, std::string& txt) {
-    int n = txt.length();
-    int m = pat.length();
-
-    std::vector<int> _llps = llps (pat);
-    std::vector<int> res;
-
-    // Pointers i and j, for traversing
-    // the text and pattern
-    int i = 0;
-    int j = 0;
-
-    while (i < n) {
-        // If characters match, move both pointers forward
-        if (txt[i] == pat[j]) {
-            i++;
-            j++;
-
-            // If the entire pattern is matched store the start index in result
-            if (j == m) {
-                res.push_back (i - j);
-
-                // Use LPS of previous index to skip unnecessary comparisons
-                j = _llps[j - 1];
-            }
-        }
-
-        // If there is a mismatch
-        else {
-            // Use lps value of previous index to avoid redundant comparisons
-            if (j != 0) j = _llps[j - 1];
-            else i++;
-        }
-    }
-    return res;
-}
-
 }  // namespace gpw::str
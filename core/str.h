@@ -1,13 +1,87 @@
 // -----------------------------------------------------------------------------
 // String process utility
 // -----------------------------------------------------------------------------
+#ifndef gpw_str_h
+#define gpw_str_h
+
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <memory_resource>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace gpw::str {
 
+// Set of bytes (e.g. whitespace) tested with a precomputed 256 entry table.
+// Sets of up to 8 bytes are also scanned 32 or 16 bytes at a time.
+class byte_class {
+  public:
+    constexpr explicit byte_class (std::string_view chars) {
+        for (const char c : chars) {
+            auto& in = _table[static_cast<unsigned char> (c)];
+            if (in) continue;
+            in = true;
+            if (_count < _members.size()) _members[_count] = c;
+            ++_count;
+        }
+    }
+
+    constexpr bool
+    contains (char c) const {
+        return _table[static_cast<unsigned char> (c)];
+    }
+
+    // Position of the first byte at or after pos in (or not in) the set, or npos
+    std::size_t
+    find_first_of (std::string_view str, std::size_t pos = 0) const;
+    std::size_t
+    find_first_not_of (std::string_view str, std::size_t pos = 0) const;
+
+    // Position of the last byte not in the set, or npos
+    std::size_t
+    find_last_not_of (std::string_view str) const;
+
+    // Number of bytes in the set, and the first 8 of them (for SIMD kernels)
+    std::size_t
+    size () const {
+        return _count;
+    }
+
+    std::string_view
+    members () const {
+        return {_members.data(), (_count < _members.size()) ? _count : _members.size()};
+    }
+
+  private:
+    std::size_t
+    _find (std::string_view str, std::size_t pos, bool member) const;
+
+    std::array<bool, 256> _table{};
+    std::array<char, 8>   _members{};
+    std::size_t           _count = 0;
+};
+
+// The default whitespace of trim and reduce
+inline constexpr byte_class default_whitespace{" \t"};
+
+// The bytes that may not occur in a file name
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+inline constexpr byte_class illegal_filename_chars{"\\/:?\"<>|"};
+#elif __APPLE__
+inline constexpr byte_class illegal_filename_chars{"\\/:?\"<>|"};
+#elif __linux__
+inline constexpr byte_class illegal_filename_chars{"\\/"};
+#else
+#error "Unknown compiler"
+#endif
+
 std::string_view
 ltrim (std::string_view str);
 std::string_view
@@ -18,6 +92,11 @@ trim (std::string_view str);
 std::string
 trim (const std::string& str, const std::string& whitespace = " \t");
 
+// Trims without copying
+std::string_view
+trim (std::string_view str, const byte_class& whitespace);
+
+// Trims and replaces each run of whitespace with fill in a single pass.
 std::string
 reduce (
     const std::string& str,
@@ -25,13 +104,50 @@ reduce (
     const std::string& whitespace = " \t"
 );
 
+std::string
+reduce (std::string_view str, std::string_view fill, const byte_class& whitespace);
+
+// Reduces the string in place; no allocation unless fill is longer than one
+// byte.
+void
+reduce_in_place (
+    std::string& str, std::string_view fill, const byte_class& whitespace = default_whitespace
+);
+
+// Reduces the buffer [data, data + length) in place and returns the view of
+// the result, which starts at data.
+std::string_view
+reduce_in_place (
+    char*             data,
+    std::size_t       length,
+    char              fill       = ' ',
+    const byte_class& whitespace = default_whitespace
+);
+
 std::string to_upper (std::string);
 std::string to_lower (std::string);
 std::string remove_illegal_char (std::string);
 
+// ASCII case conversion.  Only 'A'-'Z' and 'a'-'z' are converted; all the
+// other bytes, including UTF-8 sequences, are left unchanged.  The buffer
+// versions write src.length() bytes to dst and return the end of the output.
+void to_upper_in_place (std::string&);
+void to_lower_in_place (std::string&);
+char* to_upper (std::string_view src, char* dst);
+char* to_lower (std::string_view src, char* dst);
+
+// Compare two strings case insensitive (ASCII), folding on the fly without
+// copies.  Returns a negative value, zero or a positive value like
+// std::string::compare.
+int
+compare_icase (std::string_view str1, std::string_view str2);
+
+bool
+equals_icase (std::string_view str1, std::string_view str2);
+
 // Compare two strings case insensitive. If strings are identical, return zero.
 int
-compare (std::string str1, std::string str2);
+compare (std::string_view str1, std::string_view str2);
 
 // Formatting string
 template <typename... Args>
@@ -83,11 +199,136 @@ format (const char* s, T value, Args... args) {
     throw std::runtime_error{"extra arguments provided to format"};
 }
 
+// std::pmr overloads
+//
+// The results are allocated from mr, e.g. an arena (see core/arena.h), rather
+// than from the default heap, so the string work of a request can be released
+// at once.
+
+std::pmr::string
+trim (std::string_view str, const byte_class& whitespace, std::pmr::memory_resource* mr);
+
+std::pmr::string
+reduce (
+    std::string_view            str,
+    std::string_view            fill,
+    const byte_class&           whitespace,
+    std::pmr::memory_resource* mr
+);
+
+std::pmr::string
+to_upper (std::string_view str, std::pmr::memory_resource* mr);
+std::pmr::string
+to_lower (std::string_view str, std::pmr::memory_resource* mr);
+std::pmr::string
+remove_illegal_char (std::string_view str, std::pmr::memory_resource* mr);
+
+// Appends a value to out like operator<< would, without a stream for strings,
+// characters and numbers.
+template <typename String, typename T>
+void
+append_formatted (String& out, const T& value) {
+    if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        out += std::string_view{value};
+    } else if constexpr (std::is_same_v<T, char>) {
+        out += value;
+    } else if constexpr (std::is_same_v<T, bool>) {
+        out += value ? '1' : '0';
+    } else if constexpr (std::is_integral_v<T>) {
+        char buf[std::numeric_limits<T>::digits10 + 2];
+        out.append (buf, std::to_chars (buf, buf + sizeof buf, value).ptr);
+    } else if constexpr (std::is_floating_point_v<T>) {
+        char       buf[32];
+        const auto length = std::snprintf (buf, sizeof buf, "%g", static_cast<double> (value));
+        out.append (buf, static_cast<std::size_t> (length));
+    } else {
+        std::ostringstream ss;
+        ss << value;
+        out += ss.str();
+    }
+}
+
+// Appends the formatted string to out; same syntax as format.
+template <typename String>
+void
+format_to (String& out, const char* s) {
+    while (s && *s) {
+        if ((*s == '{' || *s == '}') && *(s + 1) == *s) {
+            out += *s;
+            s += 2;
+        } else if (*s == '{' && *(s + 1) == '}') {
+            throw std::runtime_error{"invalid format: missing arguments"};
+        } else if (*s == '{') {
+            throw std::runtime_error{"invalid format: { should be followed by another { or }"};
+        } else if (*s == '}') {
+            throw std::runtime_error{"invalid format: } should be followed by another }"};
+        } else {
+            out += *s++;
+        }
+    }
+}
+
+template <typename String, typename T, typename... Args>
+void
+format_to (String& out, const char* s, const T& value, const Args&... args) {
+    while (s && *s) {
+        if ((*s == '{' || *s == '}') && *(s + 1) == *s) {
+            out += *s;
+            s += 2;
+        } else if (*s == '{' && *(s + 1) == '}') {
+            append_formatted (out, value);
+            format_to (out, s + 2, args...);
+            return;
+        } else if (*s == '{') {
+            throw std::runtime_error{"invalid format: { should be followed by another { or }"};
+        } else if (*s == '}') {
+            throw std::runtime_error{"invalid format: } should be followed by another }"};
+        } else {
+            out += *s++;
+        }
+    }
+    throw std::runtime_error{"extra arguments provided to format"};
+}
+
+template <typename... Args>
+std::pmr::string
+format (std::pmr::memory_resource* mr, const char* s, const Args&... args) {
+    std::pmr::string out{mr};
+    format_to (out, s, args...);
+    return out;
+}
+
+// Appends str to out as a JSON string: quoted, with quotes, backslashes and
+// control characters escaped.
+void
+append_json_string (std::string& out, std::string_view str);
+
 // KMP (Knuth-Morris-Pratt) search algorithm
 std::vector<int>
-llps (std::string& pat);
+llps (std::string_view pat);
 
+// Find all (possibly overlapping) occurrences of pat in txt.  An empty pattern
+// matches nothing.  Throws runtime_error if txt is longer than INT_MAX bytes,
+// whose positions int cannot hold; find_all has no such limit.
 std::vector<int>
-search (std::string& pat, std::string& txt);
+search (std::string_view pat, std::string_view txt);
+
+// Stores the positions of all the occurrences of pat in txt in out, and
+// returns their count.
+std::size_t
+find_all (std::string_view pat, std::string_view txt, std::vector<std::size_t>& out);
+
+// Find the first occurrence of pat in txt at or after pos.  Returns npos if
+// there is none or if the pattern is empty.
+//
+// Candidate positions are filtered by comparing the first and last bytes of the
+// pattern 32 (AVX2) or 16 (SSE2) bytes at a time, the instruction set being
+// chosen at run time.  If the filter keeps producing candidates (e.g.
+// repetitive text), the rest of the text is searched with KMP so that the
+// running time stays linear.
+std::size_t
+find_first (std::string_view pat, std::string_view txt, std::size_t pos = 0);
 
 }  // namespace gpw::str
+
+#endif
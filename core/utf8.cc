@@ -0,0 +1,382 @@
+#include "core/utf8.h"
+#include "core/simd.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace gpw::str {
+
+namespace {
+
+// Length of the sequence begun by each byte: 1 for ASCII, 2 to 4 for the lead
+// bytes, and 0 for the continuation bytes and the bytes which never occur in
+// UTF-8 (0xC0, 0xC1 and 0xF5 to 0xFF).
+constexpr std::array<std::uint8_t, 256> lead_length = [] {
+    std::array<std::uint8_t, 256> table{};
+    for (int c = 0; c < 256; ++c) {
+        if (c < 0x80) table[c] = 1;
+        else if (c >= 0xC2 && c < 0xE0) table[c] = 2;
+        else if (c >= 0xE0 && c < 0xF0) table[c] = 3;
+        else if (c >= 0xF0 && c < 0xF5) table[c] = 4;
+    }
+    return table;
+}();
+
+bool
+is_continuation (unsigned char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// Length of the valid sequence at pos, or 0 if the byte at pos does not begin
+// one.  The range of the second byte excludes the overlong forms (after 0xE0
+// and 0xF0), the surrogates (after 0xED) and the code points above U+10FFFF
+// (after 0xF4).
+std::size_t
+sequence_length (const unsigned char* s, std::size_t n, std::size_t pos) {
+    const std::size_t length = lead_length[s[pos]];
+    if (length <= 1) return length;
+    if (pos + length > n) return 0;
+
+    unsigned char lo = 0x80, hi = 0xBF;
+    switch (s[pos]) {
+    case 0xE0: lo = 0xA0; break;
+    case 0xED: hi = 0x9F; break;
+    case 0xF0: lo = 0x90; break;
+    case 0xF4: hi = 0x8F; break;
+    default: break;
+    }
+    if (s[pos + 1] < lo || s[pos + 1] > hi) return 0;
+
+    for (std::size_t i = 2; i < length; ++i)
+        if (!is_continuation (s[pos + i])) return 0;
+    return length;
+}
+
+// Start of the last sequence before pos if it is truncated at pos, or pos.
+// The bytes [start, pos) must be valid, except for the last 3 bytes, which
+// may be a truncated sequence or a lead byte which never occurs in UTF-8.
+std::size_t
+sequence_start (const unsigned char* s, std::size_t start, std::size_t pos) {
+    std::size_t lead = pos;
+    while (lead > start && pos - lead < 4) {
+        --lead;
+        if (is_continuation (s[lead])) continue;
+
+        const std::size_t length = lead_length[s[lead]];
+        return (length == 0 || lead + length > pos) ? lead : pos;
+    }
+    return pos;
+}
+
+// Skips the clean bytes from pos, which must begin a sequence: the valid UTF-8
+// which contains no member of the set.  Returns the start of the first
+// sequence that may not be clean (or n), and stores in dirty_end the end of
+// the block which failed the check.  The bytes from the returned position to
+// dirty_end must be decoded one by one.
+using skip_fn = std::size_t (*) (
+    const unsigned char* s, std::size_t n, std::size_t pos, std::string_view members,
+    std::size_t& dirty_end
+);
+
+std::size_t
+skip_clean_scalar (
+    const unsigned char*, std::size_t n, std::size_t pos, std::string_view,
+    std::size_t& dirty_end
+) {
+    dirty_end = n;
+    return pos;
+}
+
+// Count of the bytes that are not continuation bytes
+using count_fn = std::size_t (*) (const unsigned char* s, std::size_t n);
+
+std::size_t
+count_leads_scalar (const unsigned char* s, std::size_t n) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < n; ++i)
+        count += !is_continuation (s[i]);
+    return count;
+}
+
+#if defined(GPW_SIMD_X86)
+// Only ASCII blocks without members of the set are skipped.
+std::size_t
+skip_clean_sse2 (
+    const unsigned char* s, std::size_t n, std::size_t pos, std::string_view members,
+    std::size_t& dirty_end
+) {
+    __m128i sets[8];
+    for (std::size_t k = 0; k < members.length(); ++k)
+        sets[k] = _mm_set1_epi8 (members[k]);
+
+    for (; pos + 16 <= n; pos += 16) {
+        const __m128i v   = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + pos));
+        __m128i       acc = v;
+        for (std::size_t k = 0; k < members.length(); ++k)
+            acc = _mm_or_si128 (acc, _mm_cmpeq_epi8 (v, sets[k]));
+
+        if (_mm_movemask_epi8 (acc) != 0) {
+            dirty_end = pos + 16;
+            return pos;
+        }
+    }
+    dirty_end = n;
+    return pos;
+}
+
+std::size_t
+count_leads_sse2 (const unsigned char* s, std::size_t n) {
+    const __m128i last_continuation = _mm_set1_epi8 (-65);  // 0xBF
+
+    std::size_t count = 0;
+    std::size_t i     = 0;
+    while (i + 16 <= n) {
+        // Byte counters, summed before they can overflow
+        __m128i acc = _mm_setzero_si128();
+        for (int k = 0; k < 255 && i + 16 <= n; ++k, i += 16) {
+            const __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (s + i));
+            acc             = _mm_sub_epi8 (acc, _mm_cmpgt_epi8 (v, last_continuation));
+        }
+        const __m128i sums = _mm_sad_epu8 (acc, _mm_setzero_si128());
+        count += static_cast<std::size_t> (_mm_cvtsi128_si64 (sums))
+               + static_cast<std::size_t> (_mm_cvtsi128_si64 (_mm_unpackhi_epi64 (sums, sums)));
+    }
+    return count + count_leads_scalar (s + i, n - i);
+}
+
+// Error flags of the pairs of bytes (see simdjson, "Validating UTF-8 In Less
+// Than One Instruction Per Byte")
+constexpr std::uint8_t too_short      = 1 << 0;  // 11______ 0_______, 11______ 11______
+constexpr std::uint8_t too_long       = 1 << 1;  // 0_______ 10______
+constexpr std::uint8_t overlong_3     = 1 << 2;  // 11100000 100_____
+constexpr std::uint8_t too_large      = 1 << 3;  // 11110100 1001____, 11110100 101_____, ...
+constexpr std::uint8_t surrogate      = 1 << 4;  // 11101101 101_____
+constexpr std::uint8_t overlong_2     = 1 << 5;  // 1100000_ 10______
+constexpr std::uint8_t too_large_1000 = 1 << 6;  // 11110101 1000____, 1111011_ 1000____, ...
+constexpr std::uint8_t overlong_4     = 1 << 6;  // 11110000 1000____
+constexpr std::uint8_t two_conts      = 1 << 7;  // 10______ 10______
+constexpr std::uint8_t carry          = too_short | too_long | two_conts;
+
+// Flags by the high nibble of the first byte, the low nibble of the first byte
+// and the high nibble of the second byte of each pair
+constexpr std::uint8_t first_high[16] = {
+    too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+    two_conts, two_conts, two_conts, two_conts,
+    too_short | overlong_2,
+    too_short,
+    too_short | overlong_3 | surrogate,
+    too_short | too_large | too_large_1000 | overlong_4
+};
+
+constexpr std::uint8_t first_low[16] = {
+    carry | overlong_3 | overlong_2 | overlong_4,
+    carry | overlong_2,
+    carry,
+    carry,
+    carry | too_large,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000 | surrogate,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000
+};
+
+constexpr std::uint8_t second_high[16] = {
+    too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_short, too_short, too_short, too_short
+};
+
+GPW_TARGET_AVX2 inline __m256i
+table_avx2 (const std::uint8_t (&table)[16]) {
+    return _mm256_broadcastsi128_si256 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (table)));
+}
+
+// The bytes of v shifted by k positions, preceded by the last bytes of prev
+template <int K>
+GPW_TARGET_AVX2 inline __m256i
+preceding_avx2 (__m256i v, __m256i prev) {
+    return _mm256_alignr_epi8 (v, _mm256_permute2x128_si256 (prev, v, 0x21), 16 - K);
+}
+
+GPW_TARGET_AVX2 inline __m256i
+high_nibbles_avx2 (__m256i v) {
+    return _mm256_and_si256 (_mm256_srli_epi16 (v, 4), _mm256_set1_epi8 (0x0F));
+}
+
+// Non-zero bytes where the sequences of the block v, preceded by the block
+// prev, are invalid
+GPW_TARGET_AVX2 inline __m256i
+utf8_errors_avx2 (__m256i v, __m256i prev) {
+    const __m256i prev1 = preceding_avx2<1> (v, prev);
+    const __m256i special =
+        _mm256_and_si256 (
+            _mm256_and_si256 (
+                _mm256_shuffle_epi8 (table_avx2 (first_high), high_nibbles_avx2 (prev1)),
+                _mm256_shuffle_epi8 (
+                    table_avx2 (first_low), _mm256_and_si256 (prev1, _mm256_set1_epi8 (0x0F))
+                )
+            ),
+            _mm256_shuffle_epi8 (table_avx2 (second_high), high_nibbles_avx2 (v))
+        );
+
+    // The third and fourth bytes of the 3 and 4 byte sequences must be
+    // continuation bytes, and only those may follow another continuation byte.
+    const __m256i third  = _mm256_subs_epu8 (preceding_avx2<2> (v, prev), _mm256_set1_epi8 (0x60));
+    const __m256i fourth = _mm256_subs_epu8 (preceding_avx2<3> (v, prev), _mm256_set1_epi8 (0x70));
+    const __m256i must_continue =
+        _mm256_and_si256 (_mm256_or_si256 (third, fourth), _mm256_set1_epi8 (-128));
+    return _mm256_xor_si256 (must_continue, special);
+}
+
+GPW_TARGET_AVX2 std::size_t
+skip_clean_avx2 (
+    const unsigned char* s, std::size_t n, std::size_t pos, std::string_view members,
+    std::size_t& dirty_end
+) {
+    __m256i sets[8];
+    for (std::size_t k = 0; k < members.length(); ++k)
+        sets[k] = _mm256_set1_epi8 (members[k]);
+
+    // Bytes greater than these end a block with a truncated sequence.
+    const __m256i max_complete = _mm256_setr_epi8 (
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+    );
+
+    const std::size_t start      = pos;
+    __m256i           prev       = _mm256_setzero_si256();
+    __m256i           incomplete = _mm256_setzero_si256();
+    for (; pos + 32 <= n; pos += 32) {
+        const __m256i v = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + pos));
+        __m256i       errors;
+        if (_mm256_movemask_epi8 (v) == 0) {
+            errors     = incomplete;
+            incomplete = _mm256_setzero_si256();
+        } else {
+            errors     = utf8_errors_avx2 (v, prev);
+            incomplete = _mm256_subs_epu8 (v, max_complete);
+        }
+        for (std::size_t k = 0; k < members.length(); ++k)
+            errors = _mm256_or_si256 (errors, _mm256_cmpeq_epi8 (v, sets[k]));
+
+        if (!_mm256_testz_si256 (errors, errors)) {
+            dirty_end = pos + 32;
+            return sequence_start (s, start, pos);
+        }
+        prev = v;
+    }
+    dirty_end = n;
+    return sequence_start (s, start, pos);
+}
+
+GPW_TARGET_AVX2 std::size_t
+count_leads_avx2 (const unsigned char* s, std::size_t n) {
+    const __m256i last_continuation = _mm256_set1_epi8 (-65);  // 0xBF
+
+    std::size_t count = 0;
+    std::size_t i     = 0;
+    while (i + 32 <= n) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < 255 && i + 32 <= n; ++k, i += 32) {
+            const __m256i v = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (s + i));
+            acc             = _mm256_sub_epi8 (acc, _mm256_cmpgt_epi8 (v, last_continuation));
+        }
+        const __m256i sums = _mm256_sad_epu8 (acc, _mm256_setzero_si256());
+        count += static_cast<std::size_t> (_mm256_extract_epi64 (sums, 0))
+               + static_cast<std::size_t> (_mm256_extract_epi64 (sums, 1))
+               + static_cast<std::size_t> (_mm256_extract_epi64 (sums, 2))
+               + static_cast<std::size_t> (_mm256_extract_epi64 (sums, 3));
+    }
+    return count + count_leads_scalar (s + i, n - i);
+}
+#endif
+
+// Calls on_invalid with the position of each byte which is a member of
+// illegal (if not null) or does not belong to a valid sequence, until it
+// returns false.
+template <typename F>
+void
+for_each_invalid (std::string_view str, const byte_class* illegal, F&& on_invalid) {
+#if defined(GPW_SIMD_X86)
+    static const skip_fn kernel = gpw::simd::has_avx2() ? skip_clean_avx2 : skip_clean_sse2;
+#else
+    static const skip_fn kernel = skip_clean_scalar;
+#endif
+    const bool             vectorized = !illegal || illegal->size() <= 8;
+    const std::string_view members    = illegal ? illegal->members() : std::string_view{};
+
+    const auto*       s   = reinterpret_cast<const unsigned char*> (str.data());
+    const std::size_t n   = str.length();
+    std::size_t       pos = 0;
+    while (pos < n) {
+        std::size_t dirty_end;
+        pos = vectorized ? kernel (s, n, pos, members, dirty_end)
+                         : skip_clean_scalar (s, n, pos, members, dirty_end);
+
+        while (pos < dirty_end) {
+            std::size_t length = sequence_length (s, n, pos);
+            if (length == 1 && illegal && illegal->contains (str[pos])) length = 0;
+            if (length == 0) {
+                if (!on_invalid (pos)) return;
+                length = 1;
+            }
+            pos += length;
+        }
+    }
+}
+
+}  // namespace
+
+std::size_t
+find_invalid_utf8 (std::string_view str) {
+    std::size_t found = std::string_view::npos;
+    for_each_invalid (str, nullptr, [&found] (std::size_t pos) {
+        found = pos;
+        return false;
+    });
+    return found;
+}
+
+bool
+is_valid_utf8 (std::string_view str) {
+    return find_invalid_utf8 (str) == std::string_view::npos;
+}
+
+std::size_t
+count_code_points (std::string_view str) {
+#if defined(GPW_SIMD_X86)
+    static const count_fn kernel = gpw::simd::has_avx2() ? count_leads_avx2 : count_leads_sse2;
+#else
+    static const count_fn kernel = count_leads_scalar;
+#endif
+    return kernel (reinterpret_cast<const unsigned char*> (str.data()), str.length());
+}
+
+void
+sanitize_in_place (std::string& str, char replacement, const byte_class& illegal) {
+    // The string is only written to at invalid positions, which the scan has
+    // already passed, so the view stays valid.
+    for_each_invalid (str, &illegal, [&str, replacement] (std::size_t pos) {
+        str[pos] = replacement;
+        return true;
+    });
+}
+
+std::string
+sanitize (std::string str, char replacement, const byte_class& illegal) {
+    sanitize_in_place (str, replacement, illegal);
+    return str;
+}
+
+}  // namespace gpw::str
@@ -0,0 +1,52 @@
+// -----------------------------------------------------------------------------
+// UTF-8 validation and sanitization
+// -----------------------------------------------------------------------------
+#ifndef gpw_utf8_h
+#define gpw_utf8_h
+
+#include "core/str.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace gpw::str {
+
+// Strings are checked 32 bytes at a time: with AVX2, the validity of UTF-8 is
+// decided for a whole block with nibble lookup tables (the algorithm of
+// simdjson), and with SSE2 blocks of ASCII are skipped.  Blocks which are not
+// known to be clean are decoded byte by byte with a lookup table of sequence
+// lengths.  Valid UTF-8 is well formed, shortest form, and excludes the
+// surrogates and the code points above U+10FFFF.
+
+// Offset of the first byte which does not begin a valid sequence, or npos if
+// the whole string is valid.
+std::size_t
+find_invalid_utf8 (std::string_view str);
+
+bool
+is_valid_utf8 (std::string_view str);
+
+// Number of code points, i.e. of bytes that are not continuation bytes.  The
+// string should be valid UTF-8.
+std::size_t
+count_code_points (std::string_view str);
+
+// Replaces the bytes of illegal and each byte of the invalid UTF-8 sequences
+// with replacement in a single pass.  The length of the string is unchanged,
+// and valid multi-byte sequences are kept.
+void
+sanitize_in_place (
+    std::string&      str,
+    char              replacement = '-',
+    const byte_class& illegal     = illegal_filename_chars
+);
+
+std::string
+sanitize (
+    std::string str, char replacement = '-', const byte_class& illegal = illegal_filename_chars
+);
+
+}  // namespace gpw::str
+
+#endif
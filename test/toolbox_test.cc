@@ -1,8 +1,34 @@
+#include "core/arena.h"
+#include "core/benchmark.h"
+#include "core/concurrency.h"
+#include "core/csv.h"
+#include "core/date_time.h"
 #include "core/filesystem.h"
+#include "core/fuzzy.h"
+#include "core/intern.h"
+#include "core/line_reader.h"
+#include "core/log.h"
+#include "core/mapped_file.h"
+#include "core/number.h"
+#include "core/parallel_fs.h"
+#include "core/profile.h"
+#include "core/progress.h"
+#include "core/search.h"
+#include "core/split.h"
 #include "core/str.h"
+#include "core/utf8.h"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <thread>
+
+#include <sys/stat.h>
+
 using namespace gpw::str;
 
 TEST (StringTest, TrimReduce) {
@@ -71,3 +97,1553 @@ TEST (String, KMP) {
         EXPECT_EQ (indices[0], 22);
     }
 }
+
+TEST (String, FindFirst) {
+    const std::string S = "the quick brown fox jumps over the lazy dog, the end";
+
+    EXPECT_EQ (find_first ("the", S), 0);
+    EXPECT_EQ (find_first ("the", S, 1), 31);
+    EXPECT_EQ (find_first ("the", S, 32), 45);
+    EXPECT_EQ (find_first ("cat", S), std::string_view::npos);
+    EXPECT_EQ (find_first ("g", S), 42);
+    EXPECT_EQ (find_first ("", S), std::string_view::npos);
+
+    // Long texts exercise the vectorized filter; compare with std::string::find
+    std::string T;
+    for (int i = 0; i < 5000; ++i)
+        T += static_cast<char> ('a' + (i * 7919) % 5);
+    for (const std::string W : {"ab", "abc", "eadcb", "acebdacebdaceb", "zz"}) {
+        std::vector<int> expected;
+        for (auto pos = T.find (W); pos != std::string::npos; pos = T.find (W, pos + 1))
+            expected.push_back (static_cast<int> (pos));
+        EXPECT_EQ (search (W, T), expected);
+    }
+
+    // Repetitive text, every position a match: verifying them all would take
+    // n * m = 2e11 byte comparisons, falling back to KMP takes linear time.
+    const std::string        A (2000000, 'a');
+    const std::string        W (100000, 'a');
+    std::vector<std::size_t> positions;
+    const double             msec = gpw::util::dt::measure_time_msec ([&] {
+        EXPECT_EQ (find_all (W, A, positions), A.size() - W.size() + 1);
+    });
+    EXPECT_LT (msec, 1000);
+    EXPECT_EQ (positions.back(), A.size() - W.size());
+
+    const auto indices = search (W.substr (0, 1000), A.substr (0, 100000));
+    EXPECT_EQ (indices.size(), 100000 - 1000 + 1);
+    EXPECT_EQ (indices.back(), 100000 - 1000);
+
+    // A periodic pattern which never matches
+    EXPECT_TRUE (search (W + "b", A).empty());
+}
+
+TEST (String, Searcher) {
+    using algorithm = searcher::algorithm;
+
+    const std::string T1 = "abaabaabbabaabaababaabaabbaaabaabaab";
+    std::string       T2;
+    for (int i = 0; i < 3000; ++i)
+        T2 += static_cast<char> ('a' + (i * 7919 + i / 13) % 3);
+
+    const std::vector<std::string> patterns = {
+        "a",         "ab",        "aab",  "abaab",   "abaabaab",          "babaabaababaab",
+        "bbbbbbbbb", "cabcabcab", "abcc", "aaaaaaa", "abcabcabcabcabcabc", "cbacbacbaabcabcabc"
+    };
+
+    std::vector<std::size_t> found;
+    for (const auto& txt : {T1, T2}) {
+        for (const auto& pat : patterns) {
+            std::vector<std::size_t> expected;
+            for (auto pos = txt.find (pat); pos != std::string::npos; pos = txt.find (pat, pos + 1))
+                expected.push_back (pos);
+
+            for (const auto algo : {algorithm::automatic, algorithm::vectorized, algorithm::kmp,
+                                    algorithm::horspool, algorithm::two_way}) {
+                const searcher s{pat, algo};
+                EXPECT_EQ (s.find_all (txt, found), expected.size());
+                EXPECT_EQ (found, expected) << pat;
+                EXPECT_EQ (s.count (txt), expected.size());
+                EXPECT_EQ (
+                    s.find_first (txt), expected.empty() ? std::string_view::npos : expected[0]
+                );
+
+                std::vector<std::size_t> lazy;
+                for (const auto pos : s.matches (txt))
+                    lazy.push_back (pos);
+                EXPECT_EQ (lazy, expected);
+            }
+        }
+    }
+
+    EXPECT_EQ (searcher{std::string (200, 'a')}.algo(), algorithm::two_way);
+    std::string   dna;
+    std::uint32_t seed = 12345;
+    for (int i = 0; i < 200; ++i) {
+        seed = seed * 1103515245 + 12345;
+        dna += "ACGT"[(seed >> 16) % 4];
+    }
+    EXPECT_EQ (searcher{dna}.algo(), algorithm::horspool);
+    EXPECT_EQ (searcher{"key"}.algo(), algorithm::vectorized);
+    EXPECT_EQ (searcher{""}.count ("abc"), 0);
+}
+
+TEST (String, MultiSearcher) {
+    using match = multi_searcher::match;
+
+    auto brute_force = [] (const std::vector<std::string>& patterns, const std::string& txt) {
+        std::vector<match> res;
+        for (std::size_t id = 0; id < patterns.size(); ++id) {
+            const auto& pat = patterns[id];
+            if (pat.empty()) continue;
+            for (auto pos = txt.find (pat); pos != std::string::npos; pos = txt.find (pat, pos + 1))
+                res.push_back ({id, pos});
+        }
+        auto key = [&patterns] (const match& m) {
+            return std::make_pair (m.pos + patterns[m.id].length(), m.id);
+        };
+        std::sort (res.begin(), res.end(), [&key] (const match& a, const match& b) {
+            return key (a) < key (b);
+        });
+        return res;
+    };
+    auto sorted = [&] (std::vector<match> v, const std::vector<std::string>& patterns) {
+        std::sort (v.begin(), v.end(), [&patterns] (const match& a, const match& b) {
+            return std::make_pair (a.pos + patterns[a.id].length(), a.id)
+                 < std::make_pair (b.pos + patterns[b.id].length(), b.id);
+        });
+        return v;
+    };
+
+    {
+        const std::vector<std::string> patterns = {"he", "she", "his", "hers", "", "she"};
+        const std::string              txt      = "ushers and his sheep";
+
+        multi_searcher     ms{patterns};
+        std::vector<match> found;
+        EXPECT_EQ (ms.find_all (txt, found), 8);
+        EXPECT_EQ (sorted (found, patterns), brute_force (patterns, txt));
+        EXPECT_EQ (ms.count ("no keyword"), 0);
+    }
+
+    // Enough patterns for the automaton to have sparse states
+    std::uint32_t seed = 7;
+    auto          rand = [&seed] (std::uint32_t n) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % n;
+    };
+
+    std::vector<std::string> patterns;
+    for (int i = 0; i < 400; ++i) {
+        std::string pat;
+        for (std::uint32_t len = 1 + rand (12); len > 0; --len)
+            pat += static_cast<char> ('a' + rand (26));
+        patterns.push_back (pat);
+    }
+    std::string txt;
+    for (int i = 0; i < 20000; ++i)
+        txt += static_cast<char> ('a' + rand (26));
+    for (int i = 0; i < 100; ++i)
+        txt.insert (rand (txt.size()), patterns[rand (patterns.size())]);
+
+    multi_searcher ms{patterns};
+    EXPECT_GT (ms.count_states(), 2000);
+
+    std::vector<match> found;
+    ms.find_all (txt, found);
+    EXPECT_EQ (sorted (found, patterns), brute_force (patterns, txt));
+    EXPECT_EQ (ms.count (txt), found.size());
+}
+
+TEST (String, StreamSearch) {
+    std::string   txt;
+    std::uint32_t seed = 3;
+    for (int i = 0; i < 5000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        txt += static_cast<char> ('a' + (seed >> 16) % 3);
+    }
+
+    const searcher           s{"abcab"};
+    std::vector<std::size_t> expected;
+    s.find_all (txt, expected);
+    ASSERT_FALSE (expected.empty());
+
+    const std::vector<std::string> patterns = {"abc", "cab", "bb", "aaab"};
+    const multi_searcher           ms{patterns};
+    std::vector<multi_searcher::match> expected_multi;
+    ms.find_all (txt, expected_multi);
+
+    for (const std::size_t chunk_size : {1, 2, 3, 7, 64, 1000}) {
+        stream_searcher                    ss{s};
+        multi_searcher::cursor             cur;
+        std::vector<std::size_t>           found, all;
+        std::vector<multi_searcher::match> found_multi, all_multi;
+        for (std::size_t pos = 0; pos < txt.length(); pos += chunk_size) {
+            const auto chunk = std::string_view{txt}.substr (pos, chunk_size);
+            ss.feed (chunk, found);
+            all.insert (all.end(), found.begin(), found.end());
+            ms.find_all (chunk, cur, found_multi);
+            all_multi.insert (all_multi.end(), found_multi.begin(), found_multi.end());
+        }
+        EXPECT_EQ (all, expected) << chunk_size;
+        EXPECT_EQ (all_multi, expected_multi) << chunk_size;
+        EXPECT_EQ (ss.offset(), txt.length());
+    }
+
+    const auto path = fs::temp_directory_path() / "gpw_stream_search_test.txt";
+    {
+        std::ofstream out (path, std::ios::binary);
+        out << txt;
+    }
+    std::vector<std::size_t> found;
+    EXPECT_EQ (search_file (path, s, found, 100), expected.size());
+    EXPECT_EQ (found, expected);
+
+    std::vector<multi_searcher::match> found_multi;
+    search_file (path, ms, found_multi, 100);
+    EXPECT_EQ (found_multi, expected_multi);
+    fs::remove (path);
+
+    EXPECT_THROW (search_file (path, s, found), std::runtime_error);
+}
+
+TEST (String, ParallelSearch) {
+    std::string   txt;
+    std::uint32_t seed = 11;
+    for (int i = 0; i < 100000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        txt += static_cast<char> ('a' + (seed >> 16) % 2);
+    }
+
+    gpw::concurrency::thread_pool pool;
+    pool.start();
+
+    std::vector<std::size_t> expected, found;
+    for (const std::string pat : {"a", "ab", "abba", "aaaaaaaaaaaa", "bababababababab"}) {
+        const searcher s{pat};
+        s.find_all (txt, expected);
+        for (const std::size_t chunk_size : {1, 10, 999, 100000}) {
+            EXPECT_EQ (find_all_parallel (s, txt, found, pool, chunk_size), expected.size());
+            EXPECT_EQ (found, expected) << pat << ", " << chunk_size;
+        }
+    }
+
+    // The first exception of a group of jobs reaches the waiting thread.
+    gpw::concurrency::first_exception error;
+    gpw::concurrency::latch           done (4);
+    for (int i = 0; i < 4; ++i) {
+        pool.queue_job ([&error, &done, i] {
+            try {
+                if (i % 2 == 1) throw std::runtime_error{"job failed"};
+            } catch (...) {
+                error.capture();
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    EXPECT_THROW (error.rethrow(), std::runtime_error);
+
+    pool.stop();
+}
+
+TEST (String, CaseConversion) {
+    std::string all;
+    for (int c = 0; c < 256; ++c)
+        all += static_cast<char> (c);
+    all += all;
+
+    std::string upper = all;
+    std::string lower = all;
+    for (auto& c : upper)
+        if (c >= 'a' && c <= 'z') c = static_cast<char> (c - 'a' + 'A');
+    for (auto& c : lower)
+        if (c >= 'A' && c <= 'Z') c = static_cast<char> (c - 'A' + 'a');
+
+    EXPECT_EQ (to_upper (all), upper);
+    EXPECT_EQ (to_lower (all), lower);
+
+    std::string str = all;
+    to_lower_in_place (str);
+    EXPECT_EQ (str, lower);
+    to_upper_in_place (str);
+    EXPECT_EQ (str, upper);
+
+    std::string buf (all.length(), '\0');
+    EXPECT_EQ (to_lower (all, buf.data()), buf.data() + buf.length());
+    EXPECT_EQ (buf, lower);
+
+    EXPECT_EQ (to_upper ("Hello, World! 123"), "HELLO, WORLD! 123");
+    EXPECT_EQ (to_lower ("Hello, World! 123"), "hello, world! 123");
+}
+
+TEST (String, CompareIcase) {
+    EXPECT_EQ (compare_icase ("Content-Length", "content-length"), 0);
+    EXPECT_LT (compare_icase ("abc", "ABD"), 0);
+    EXPECT_GT (compare_icase ("abd", "ABC"), 0);
+    EXPECT_LT (compare_icase ("abc", "ABCD"), 0);
+    EXPECT_GT (compare_icase ("abcd", "ABC"), 0);
+    EXPECT_EQ (compare_icase ("", ""), 0);
+    EXPECT_NE (compare_icase ("[", "{"), 0);
+    EXPECT_EQ (compare ("Hello", "hELLO"), 0);
+
+    EXPECT_TRUE (equals_icase ("Transfer-Encoding", "TRANSFER-ENCODING"));
+    EXPECT_FALSE (equals_icase ("Transfer-Encoding", "Transfer-Encodin"));
+    EXPECT_FALSE (equals_icase ("@", "`"));
+
+    // Long strings differing at every position
+    const std::string base = "The Quick Brown Fox Jumps Over The Lazy Dog 0123456789 !?";
+    const std::string same = to_upper (base);
+    EXPECT_TRUE (equals_icase (base, same));
+    for (std::size_t i = 0; i < base.length(); ++i) {
+        std::string other = same;
+        other[i]          = '~';
+        const int expected =
+            std::tolower (static_cast<unsigned char> (base[i])) - static_cast<int> ('~');
+        EXPECT_EQ (compare_icase (base, other) < 0, expected < 0) << i;
+        EXPECT_FALSE (equals_icase (base, other)) << i;
+    }
+}
+
+TEST (String, SearchIgnoreCase) {
+    using algorithm = searcher::algorithm;
+
+    std::string   txt;
+    std::uint32_t seed = 5;
+    for (int i = 0; i < 4000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        txt += "aAbB-["[(seed >> 16) % 6];
+    }
+    const std::string folded = to_lower (txt);
+
+    std::vector<std::size_t> expected, found;
+    for (const std::string pat : {"A", "[", "Ab", "aB-b", "BBAab", "ab-ABba[aAbab-bab", "-"}) {
+        const std::string lower = to_lower (pat);
+        expected.clear();
+        for (auto pos = folded.find (lower); pos != std::string::npos;
+             pos      = folded.find (lower, pos + 1))
+            expected.push_back (pos);
+
+        for (const auto algo : {algorithm::automatic, algorithm::vectorized, algorithm::kmp,
+                                algorithm::horspool, algorithm::two_way}) {
+            const searcher s{pat, algo, true};
+            EXPECT_TRUE (s.ignore_case());
+            s.find_all (txt, found);
+            EXPECT_EQ (found, expected) << pat;
+        }
+    }
+
+    const searcher icase{"Content-Type", algorithm::automatic, true};
+    EXPECT_EQ (icase.find_first ("x: CONTENT-type"), 3);
+    EXPECT_EQ (searcher{"Content-Type"}.find_first ("x: CONTENT-type"), std::string_view::npos);
+
+    const multi_searcher               ms{std::vector<std::string_view>{"Error", "WARN"}, true};
+    std::vector<multi_searcher::match> matches;
+    EXPECT_EQ (ms.find_all ("error: warning, ERROR", matches), 3);
+    EXPECT_EQ (matches[0], (multi_searcher::match{0, 0}));
+    EXPECT_EQ (matches[1], (multi_searcher::match{1, 7}));
+    EXPECT_EQ (matches[2], (multi_searcher::match{0, 16}));
+}
+
+TEST (StringTest, ReduceSinglePass) {
+    const std::string foo = "    too much\t   \tspace\t\t\t  ";
+
+    EXPECT_EQ (trim (std::string_view{foo}, default_whitespace), "too much\t   \tspace");
+    EXPECT_EQ (trim (std::string_view{"  \t "}, default_whitespace), "");
+    EXPECT_EQ (reduce (std::string_view{foo}, "--", default_whitespace), "too--much--space");
+    EXPECT_EQ (reduce (std::string_view{foo}, "", default_whitespace), "toomuchspace");
+    EXPECT_EQ (reduce ("a,,b;c", "_", ",;"), "a_b_c");
+
+    std::string str = foo;
+    reduce_in_place (str, " ");
+    EXPECT_EQ (str, "too much space");
+
+    str = foo;
+    reduce_in_place (str, "<>");
+    EXPECT_EQ (str, "too<>much<>space");
+
+    char buf[] = "  one   two\tthree  ";
+    EXPECT_EQ (reduce_in_place (buf, sizeof (buf) - 1, '_'), "one_two_three");
+
+    // Long input with many runs, compared with a straightforward reduction
+    std::string   txt, expected;
+    std::uint32_t seed = 17;
+    for (int i = 0; i < 3000; ++i) {
+        seed           = seed * 1103515245 + 12345;
+        const auto len = 1 + (seed >> 16) % 40;
+        if ((seed >> 8) % 2) {
+            txt += std::string (len, (seed >> 4) % 2 ? ' ' : '\t');
+            if (!expected.empty() && expected.back() != ' ') expected += ' ';
+        } else {
+            txt += std::string (len, 'x');
+            expected += std::string (len, 'x');
+        }
+    }
+    if (!expected.empty() && expected.back() == ' ') expected.pop_back();
+    EXPECT_EQ (reduce (txt), expected);
+
+    const byte_class many{"abcdefghij"};
+    EXPECT_EQ (many.find_first_not_of ("abcabcabcabcabcabcabcabcabcabcabcabcZ"), 36);
+    EXPECT_EQ (many.find_first_of ("0123456789012345678901234567890123456789j"), 40);
+    EXPECT_EQ (many.find_last_not_of ("abc"), std::string_view::npos);
+}
+
+TEST (String, Split) {
+    auto collect = [] (const split_view& view) {
+        std::vector<std::string_view> tokens;
+        for (const auto token : view)
+            tokens.push_back (token);
+        return tokens;
+    };
+    using tokens = std::vector<std::string_view>;
+
+    EXPECT_EQ (collect (split ("a,b,,c", ',')), (tokens{"a", "b", "", "c"}));
+    EXPECT_EQ (collect (split ("a,b,,c,", ',', split_view::skip_empty)), (tokens{"a", "b", "c"}));
+    EXPECT_EQ (collect (split ("", ',')), (tokens{""}));
+    EXPECT_EQ (collect (split ("", ',', split_view::skip_empty)), tokens{});
+    EXPECT_EQ (
+        collect (split (" a ; b ;; ", ';', split_view::trim_tokens | split_view::skip_empty)),
+        (tokens{"a", "b"})
+    );
+    EXPECT_EQ (collect (split ("k1=v1&&k2=v2", "&&")), (tokens{"k1=v1", "k2=v2"}));
+    EXPECT_EQ (collect (split ("a;b,c", byte_class{",;"})), (tokens{"a", "b", "c"}));
+    EXPECT_EQ (collect (tokenize ("  too much\t space ")), (tokens{"too", "much", "space"}));
+
+    // Fields across 64 byte blocks
+    std::string   line;
+    tokens        expected;
+    std::uint32_t seed = 23;
+    std::string   storage (1000, 'x');
+    for (int i = 0; i < 300; ++i) {
+        seed           = seed * 1103515245 + 12345;
+        const auto len = (seed >> 16) % 150;
+        expected.push_back (std::string_view{storage}.substr (0, len));
+        line += storage.substr (0, len);
+        if (i + 1 < 300) line += '|';
+    }
+    EXPECT_EQ (collect (split (line, '|')), expected);
+
+    const auto view = split (line, '|');
+    EXPECT_EQ (std::distance (view.begin(), view.end()), 300);
+}
+
+TEST (String, Csv) {
+    using rows = std::vector<std::vector<std::string>>;
+
+    auto parse = [] (std::string_view data, csv_dialect dialect = {}) {
+        rows                          result;
+        csv_parser                    parser{data, dialect};
+        std::vector<std::string_view> fields;
+        while (parser.next (fields))
+            result.emplace_back (fields.begin(), fields.end());
+        return result;
+    };
+
+    EXPECT_EQ (parse ("a,b,c\n1,,3"), (rows{{"a", "b", "c"}, {"1", "", "3"}}));
+    EXPECT_EQ (
+        parse ("\"x,y\",\"say \"\"hi\"\"\"\r\n\"multi\nline\",\"\"\r\n"),
+        (rows{{"x,y", "say \"hi\""}, {"multi\nline", ""}})
+    );
+    EXPECT_EQ (parse ("\n,\n"), (rows{{""}, {"", ""}}));
+    EXPECT_EQ (parse (""), rows{});
+    EXPECT_EQ (parse ("a\tb,c\n", tsv_dialect), (rows{{"a", "b,c"}}));
+
+    // Generated records crossing many blocks, with every field quoted when it
+    // contains a delimiter, a quote, or a line break
+    rows          expected;
+    std::string   data;
+    std::uint32_t seed = 5;
+    for (int r = 0; r < 2000; ++r) {
+        seed = seed * 1103515245 + 12345;
+        expected.emplace_back (1 + (seed >> 16) % 6);
+        for (std::size_t f = 0; f < expected.back().size(); ++f) {
+            std::string& field = expected.back()[f];
+            seed               = seed * 1103515245 + 12345;
+            const int length   = (seed >> 16) % 12;
+            for (int i = 0; i < length; ++i) {
+                seed = seed * 1103515245 + 12345;
+                field += "ab,\"\n\r"[(seed >> 16) % 6];
+            }
+
+            if (f > 0) data += ',';
+            if (field.find_first_of (",\"\n\r") == std::string::npos) {
+                data += field;
+                continue;
+            }
+            data += '"';
+            for (const char c : field)
+                data += (c == '"') ? std::string{"\"\""} : std::string{c};
+            data += '"';
+        }
+        data += (r % 2) ? "\n" : "\r\n";
+    }
+    EXPECT_EQ (parse (data), expected);
+
+    gpw::concurrency::thread_pool pool;
+    pool.start();
+
+    for (const std::size_t count : {2, 7, 100}) {
+        rows split;
+        for (const auto chunk : split_records (data, count, pool)) {
+            const rows part = parse (chunk);
+            split.insert (split.end(), part.begin(), part.end());
+        }
+        EXPECT_EQ (split, expected) << count;
+    }
+
+    std::vector<rows> chunks (data.length() / 1000 + 1);
+    parse_parallel (
+        data,
+        pool,
+        [&chunks] (std::size_t i, csv_parser& parser) {
+            std::vector<std::string_view> fields;
+            while (parser.next (fields))
+                chunks[i].emplace_back (fields.begin(), fields.end());
+        },
+        {},
+        1000
+    );
+    rows parallel;
+    for (const auto& part : chunks)
+        parallel.insert (parallel.end(), part.begin(), part.end());
+    EXPECT_EQ (parallel, expected);
+
+    // An exception of the handler is rethrown once all the chunks are parsed.
+    std::atomic<std::size_t> count_chunks{0};
+    EXPECT_THROW (
+        parse_parallel (
+            data,
+            pool,
+            [&count_chunks] (std::size_t i, csv_parser&) {
+                ++count_chunks;
+                if (i == 1) throw std::runtime_error{"bad chunk"};
+            },
+            {},
+            1000
+        ),
+        std::runtime_error
+    );
+    EXPECT_EQ (count_chunks, chunks.size());
+
+    pool.stop();
+}
+
+TEST (String, Utf8) {
+    // Length of the valid sequence at i, or 0, decoding the code point
+    auto sequence = [] (std::string_view str, std::size_t i) -> std::size_t {
+        const unsigned char c = str[i];
+        std::size_t         length;
+        std::uint32_t       cp;
+        if (c < 0x80) return 1;
+        if ((c >> 5) == 6) {
+            length = 2;
+            cp     = c & 0x1F;
+        } else if ((c >> 4) == 14) {
+            length = 3;
+            cp     = c & 0x0F;
+        } else if ((c >> 3) == 30) {
+            length = 4;
+            cp     = c & 0x07;
+        } else {
+            return 0;
+        }
+        if (i + length > str.length()) return 0;
+        for (std::size_t k = 1; k < length; ++k) {
+            if ((str[i + k] & 0xC0) != 0x80) return 0;
+            cp = (cp << 6) | (str[i + k] & 0x3F);
+        }
+        const std::uint32_t min[] = {0, 0, 0x80, 0x800, 0x10000};
+        if (cp < min[length] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+        return length;
+    };
+
+    auto reference = [&sequence] (std::string str, std::size_t& first, std::size_t& count) {
+        first = std::string::npos;
+        count = 0;
+        for (std::size_t i = 0; i < str.length();) {
+            std::size_t length = sequence (str, i);
+            if (length == 0 || str[i] == '/') {
+                if (first == std::string::npos) first = i;
+                str[i] = '-';
+                length = 1;
+            }
+            ++count;
+            i += length;
+        }
+        return str;
+    };
+
+    EXPECT_TRUE (is_valid_utf8 (""));
+    EXPECT_TRUE (is_valid_utf8 ("h\xC3\xA9llo \xE2\x82\xAC \xF0\x9F\x98\x80 \xF4\x8F\xBF\xBF"));
+    EXPECT_EQ (find_invalid_utf8 ("ab\xC0\xAF"), 2);
+    EXPECT_EQ (find_invalid_utf8 ("\xE0\x80\x80"), 0);
+    EXPECT_EQ (find_invalid_utf8 ("a\xED\xA0\x80"), 1);
+    EXPECT_EQ (find_invalid_utf8 ("\xF4\x90\x80\x80"), 0);
+    EXPECT_EQ (find_invalid_utf8 ("abc\xE2\x82"), 3);
+    EXPECT_EQ (count_code_points ("h\xC3\xA9llo \xE2\x82\xAC"), 7);
+    EXPECT_EQ (sanitize ("a/b\xC3\xA9\xFF", '_', byte_class{"/"}), "a_b\xC3\xA9_");
+    EXPECT_EQ (remove_illegal_char ("a/b/c"), "a-b-c");
+
+    const char* valid[]   = {"a", "Z", " ", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80",
+                             "\xF4\x8F\xBF\xBF", "\xED\x9F\xBF", "\xEE\x80\x80"};
+    const char* invalid[] = {"\x80", "\xC0\xAF", "\xE0\x80\x80", "\xED\xA0\x80", "\xF4\x90\x80\x80",
+                             "\xFF", "\xE2\x82", "\xF0\x9F\x98", "/"};
+
+    std::uint32_t seed = 17;
+    auto          next = [&seed] (std::uint32_t k) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % k;
+    };
+    for (int round = 0; round < 300; ++round) {
+        std::string str;
+        const auto  length = 1 + next (200);
+        while (str.length() < length)
+            str += (next (40) == 0) ? invalid[next (9)] : valid[next (9)];
+
+        for (std::size_t skip = 0; skip < 40 && skip < str.length(); skip += 3) {
+            const std::string part = str.substr (skip);
+            std::size_t       first, count;
+            const std::string sanitized = reference (part, first, count);
+
+            const bool has_slash = part.find ('/') != std::string::npos;
+            if (!has_slash) {
+                EXPECT_EQ (find_invalid_utf8 (part), first) << round << ", " << skip;
+                EXPECT_EQ (count_code_points (sanitized), count);
+            }
+            EXPECT_EQ (sanitize (part, '-', byte_class{"/"}), sanitized);
+            EXPECT_TRUE (is_valid_utf8 (sanitized));
+        }
+    }
+}
+
+TEST (String, Number) {
+    EXPECT_EQ (parse_int ("42").value, 42);
+    EXPECT_EQ (parse_int ("+42").value, 42);
+    EXPECT_EQ (parse_int ("-9223372036854775808").value, INT64_MIN);
+    EXPECT_EQ (parse_int<std::uint8_t> ("ff", 16).value, 255);
+    EXPECT_EQ (parse_int ("").error, std::errc::invalid_argument);
+    EXPECT_EQ (parse_int ("12a").error, std::errc::invalid_argument);
+    EXPECT_EQ (parse_int (" 12").error, std::errc::invalid_argument);
+    EXPECT_EQ (parse_int ("+-1").error, std::errc::invalid_argument);
+    EXPECT_EQ (parse_int<unsigned> ("-1").error, std::errc::invalid_argument);
+    EXPECT_EQ (parse_int<std::int16_t> ("40000").error, std::errc::result_out_of_range);
+    EXPECT_FALSE (parse_int ("x"));
+
+    EXPECT_EQ (parse_double ("3.25").value, 3.25);
+    EXPECT_EQ (parse_double ("-1e-3").value, -1e-3);
+    EXPECT_EQ (parse_double ("+2E2").value, 200.0);
+    EXPECT_EQ (parse_double ("1e400").error, std::errc::result_out_of_range);
+    EXPECT_EQ (parse_double ("1.5x").error, std::errc::invalid_argument);
+    EXPECT_EQ (parse_double (".").error, std::errc::invalid_argument);
+
+    std::vector<long long> ints;
+    EXPECT_EQ (parse_int ({"1", "-2", "3"}, ints), std::string_view::npos);
+    EXPECT_EQ (ints, (std::vector<long long>{1, -2, 3}));
+    EXPECT_EQ (parse_int ({"1", "x", "3", "y"}, ints), 1);
+    EXPECT_EQ (ints, (std::vector<long long>{1, 0, 3, 0}));
+
+    std::vector<double> doubles;
+    EXPECT_EQ (parse_double ({"0.5", "1e3", "", "-2"}, doubles), 2);
+    EXPECT_EQ (doubles, (std::vector<double>{0.5, 1000.0, 0.0, -2.0}));
+
+    EXPECT_EQ (format_int (7), "7");
+    EXPECT_EQ (format_int (7, 3), "007");
+    EXPECT_EQ (format_int (-42, 5), "-0042");
+    EXPECT_EQ (format_int (12345, 3), "12345");
+    EXPECT_EQ (format_int (INT64_MIN), "-9223372036854775808");
+    EXPECT_EQ (format_int (UINT64_MAX, 21), "018446744073709551615");
+    EXPECT_EQ (format_int (5u, 40), std::string (39, '0') + "5");
+
+    char       buf[32];
+    const auto end = format_int (2024, format_int (9, buf, 2), 6);
+    EXPECT_EQ (std::string (buf, end), "09002024");
+
+    for (const double d : {0.1, 1.0 / 3, 1e-300, -123456.789, 6.02214076e23})
+        EXPECT_EQ (parse_double (format_double (d)).value, d);
+    EXPECT_EQ (format_double (0.25), "0.25");
+}
+
+TEST (String, Arena) {
+    // Counts the allocations passed to the heap
+    struct counting_resource : std::pmr::memory_resource {
+        std::size_t allocations = 0;
+        std::size_t live        = 0;
+
+        void*
+        do_allocate (std::size_t bytes, std::size_t alignment) override {
+            ++allocations;
+            ++live;
+            return std::pmr::new_delete_resource()->allocate (bytes, alignment);
+        }
+
+        void
+        do_deallocate (void* p, std::size_t bytes, std::size_t alignment) override {
+            --live;
+            std::pmr::new_delete_resource()->deallocate (p, bytes, alignment);
+        }
+
+        bool
+        do_is_equal (const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    } heap;
+
+    arena a{&heap};
+
+    const auto trimmed = trim ("  Hello  World  ", default_whitespace, &a);
+    EXPECT_EQ (trimmed, "Hello  World");
+    EXPECT_EQ (trimmed.get_allocator().resource(), &a);
+    EXPECT_EQ (reduce ("  a \t b  ", "_", default_whitespace, &a), "a_b");
+    EXPECT_EQ (to_upper ("MiXeD 1", &a), "MIXED 1");
+    EXPECT_EQ (to_lower ("MiXeD 1", &a), "mixed 1");
+    EXPECT_EQ (remove_illegal_char ("a/b", &a), "a-b");
+    EXPECT_EQ (heap.allocations, 0u);  // Within the inline buffer
+
+    EXPECT_EQ (format (&a, "{}-{} {{{}}} {}", 42, "x", 'c', 2.5), "42-x {c} 2.5");
+    EXPECT_EQ (
+        std::string_view{format (&a, "{} {} {}", -7LL, true, 1.0 / 3)},
+        format ("{} {} {}", -7LL, true, 1.0 / 3)
+    );
+    EXPECT_THROW (format (&a, "{}"), std::runtime_error);
+    EXPECT_THROW (format (&a, "{", 1), std::runtime_error);
+    EXPECT_THROW (format (&a, "none", 1), std::runtime_error);
+
+    for (int i = 0; i < 100; ++i)
+        to_upper (std::string (1000, 'x'), &a);
+    EXPECT_GT (heap.allocations, 0u);
+    EXPECT_LT (heap.allocations, 20u);  // Growing chunks
+    EXPECT_GE (a.allocated(), 100000u);
+
+    a.release();
+    EXPECT_EQ (heap.live, 0u);
+    EXPECT_EQ (a.allocated(), 0u);
+
+    const std::size_t allocations = heap.allocations;
+    EXPECT_EQ (to_lower ("AGAIN", &a), "again");
+    EXPECT_EQ (heap.allocations, allocations);
+}
+
+TEST (String, Intern) {
+    intern_table table;
+
+    const auto a = table.id ("alpha");
+    const auto b = table.id ("beta");
+    EXPECT_NE (a, b);
+    EXPECT_EQ (table.id (std::string{"alp"} + "ha"), a);
+    EXPECT_EQ (table.str (a), "alpha");
+    EXPECT_EQ (table.str (b), "beta");
+    EXPECT_EQ (table.intern ("alpha").data(), table.str (a).data());
+    EXPECT_EQ (table.intern (""), "");
+    EXPECT_NE (table.intern ("").data(), table.intern ("x").data());
+    EXPECT_EQ (table.size(), 4u);
+    EXPECT_THROW (table.str (12345678), std::runtime_error);
+
+    // Threads interning overlapping sets of strings agree on the ids.
+    constexpr int                                   count_threads = 4;
+    std::vector<std::vector<intern_table::id_type>> ids (count_threads);
+    std::vector<std::thread>                        threads;
+    for (int t = 0; t < count_threads; ++t) {
+        threads.emplace_back ([&table, &ids, t] {
+            for (int i = 0; i < 20000; ++i)
+                ids[t].push_back (table.id ("message " + std::to_string ((i * (t + 1)) % 5000)));
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ (table.size(), 4u + 5000u);
+    for (int t = 0; t < count_threads; ++t) {
+        for (int i = 0; i < 20000; i += 7) {
+            const std::string str = "message " + std::to_string ((i * (t + 1)) % 5000);
+            EXPECT_EQ (ids[t][i], table.id (str));
+            EXPECT_EQ (table.str (ids[t][i]), str);
+        }
+    }
+
+    // A table for a single thread has few shards; the ids stay distinct.
+    intern_table                       small{1};
+    std::vector<intern_table::id_type> small_ids;
+    for (int i = 0; i < 1000; ++i)
+        small_ids.push_back (small.id (std::to_string (i)));
+    std::sort (small_ids.begin(), small_ids.end());
+    EXPECT_EQ (std::unique (small_ids.begin(), small_ids.end()), small_ids.end());
+    EXPECT_EQ (small.str (small.id ("999")), "999");
+    EXPECT_EQ (small.size(), 1000u);
+
+    gpw::utils::logger_t logger;
+    logger.enable_console_output (false);
+    for (int i = 0; i < 3; ++i) {
+        logger.info ("repeated");
+        logger.warn ("message " + std::to_string (i));
+    }
+
+    const auto path = fs::temp_directory_path() / "gpw_intern_log_test.txt";
+    logger.write (path);
+    std::ifstream     in (path);
+    const std::string content{std::istreambuf_iterator<char> (in), {}};
+    EXPECT_EQ (content, "repeated\nmessage 0\nrepeated\nmessage 1\nrepeated\nmessage 2\n");
+    fs::remove (path);
+}
+
+TEST (String, FuzzySearch) {
+    // Sellers' dynamic programming: the smallest edit distance of pat to a
+    // substring of txt ending at each offset
+    auto reference = [] (std::string_view pat, std::string_view txt, std::size_t k, bool icase) {
+        std::vector<fuzzy_searcher::match> found;
+        std::vector<std::size_t>           col (pat.length() + 1), prev;
+        for (std::size_t i = 0; i <= pat.length(); ++i)
+            col[i] = i;
+        for (std::size_t j = 0; j < txt.length(); ++j) {
+            prev   = col;
+            col[0] = 0;
+            for (std::size_t i = 1; i <= pat.length(); ++i) {
+                const bool same = icase ? equals_icase (pat.substr (i - 1, 1), txt.substr (j, 1))
+                                        : pat[i - 1] == txt[j];
+                col[i]          = std::min ({prev[i] + 1, col[i - 1] + 1, prev[i - 1] + !same});
+            }
+            if (col[pat.length()] <= k) found.push_back ({j + 1, col[pat.length()]});
+        }
+        return found;
+    };
+
+    const fuzzy_searcher fs{"receive", 2};
+    std::vector<fuzzy_searcher::match> found;
+    EXPECT_TRUE (fs.contains ("please recieve this"));
+    EXPECT_FALSE (fs.contains ("nothing to see"));
+    EXPECT_EQ (fs.find_all ("xreceivex", found), 4u);
+    EXPECT_EQ (found[2], (fuzzy_searcher::match{8, 0}));
+
+    std::uint32_t seed = 3;
+    auto          next = [&seed] (std::uint32_t k) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % k;
+    };
+    for (int round = 0; round < 120; ++round) {
+        const bool  icase = round % 4 == 3;
+        std::string txt;
+        for (int i = 0; i < 2000; ++i)
+            txt += static_cast<char> ((icase && next (2) ? 'A' : 'a') + next (4));
+
+        const std::size_t lengths[] = {1, 5, 12, 40, 64, 65, 100, 150};
+        const std::size_t m         = lengths[round % 8];
+        const std::size_t k         = next (m < 8 ? 2 : 5);
+        std::string       pat       = txt.substr (next (1500), m);
+        for (std::size_t e = next (k + 2); e > 0; --e)
+            pat[next (m)] = 'x';
+
+        const fuzzy_searcher searcher{pat, k, icase};
+        const std::size_t    count = searcher.find_all (txt, found);
+        EXPECT_EQ (count, found.size());
+        EXPECT_EQ (found, reference (pat, txt, k, icase)) << round << ": " << pat << ", " << k;
+        EXPECT_EQ (searcher.count (txt), found.size());
+        EXPECT_EQ (searcher.contains (txt), !found.empty());
+    }
+
+    // Long enough for the interleaved stripes of the unfiltered scan
+    std::string txt;
+    for (int i = 0; i < 50000; ++i)
+        txt += static_cast<char> ('a' + next (4));
+    for (const std::size_t k : {2, 3}) {
+        const std::string    pat = txt.substr (12345, 7);
+        const fuzzy_searcher searcher{pat, k};
+        searcher.find_all (txt, found);
+        EXPECT_EQ (found, reference (pat, txt, k, false)) << k;
+    }
+}
+
+TEST (DateTime, TimeStamp) {
+    namespace dt = gpw::util::dt;
+
+    // Reference built on strftime with the reentrant libc conversions
+    auto reference = [] (long long msecs, const char* fmt, bool show_msec, bool utc) {
+        const long long secs = msecs / 1000 - (msecs % 1000 < 0);
+        const auto      t    = static_cast<std::time_t> (secs);
+        std::tm         tm{};
+        if (utc) gmtime_r (&t, &tm);
+        else localtime_r (&t, &tm);
+        char buf[64];
+        auto length = std::strftime (buf, sizeof buf, fmt, &tm);
+        if (show_msec)
+            length += std::snprintf (buf + length, 8, ".%03d", int (msecs - secs * 1000));
+        return std::string (buf, length) + (utc ? "-UTC" : "");
+    };
+
+    auto check = [&reference] (long long msecs) {
+        char buf[dt::max_time_stamp_length];
+        for (const bool show_msec : {false, true}) {
+            for (const bool utc : {false, true}) {
+                const std::string expected = reference (msecs, "%Y-%m-%dT%H-%M-%S", show_msec, utc);
+                if (dt::time_stamp (msecs, show_msec, utc) != expected) return false;
+            }
+            const std::string time = reference (msecs, "%H:%M:%S", show_msec, false);
+            if (std::string (buf, dt::format_time (msecs, true, show_msec, buf)) != time)
+                return false;
+        }
+        return std::string (buf, dt::format_date (msecs, false, buf))
+            == reference (msecs, "%Y%m%d", false, false);
+    };
+
+    EXPECT_EQ (dt::time_stamp (0, true, true), "1970-01-01T00-00-00.000-UTC");
+    EXPECT_EQ (dt::time_stamp (-1, true, true), "1969-12-31T23-59-59.999-UTC");
+    EXPECT_EQ (dt::time_stamp (951782400123, true, true), "2000-02-29T00-00-00.123-UTC");
+
+    // Each time zone is checked in a new thread, which starts with an empty
+    // offset cache: consecutive times move across the hours and the DST
+    // transitions, including ones which are not on a UTC hour.
+    const char* const saved = std::getenv ("TZ");
+    const std::string saved_tz{saved ? saved : ""};
+    for (const char* tz :
+         {"UTC0", "EST5EDT,M3.2.0,M11.1.0", "NST3:30NDT,M3.2.0,M11.1.0",
+          "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0"}) {
+        setenv ("TZ", tz, 1);
+        tzset();
+
+        int  count_errors = 0;
+        auto run          = [&] (long long first, long long step, int count, int* errors) {
+            for (int i = 0; i < count; ++i)
+                *errors += !check (first + i * step);
+        };
+        std::thread{run, 1600000000000LL, 997003LL, 40000, &count_errors}.join();
+        std::thread{run, -2000000000000LL, 86399999LL, 2000, &count_errors}.join();
+        EXPECT_EQ (count_errors, 0) << tz;
+
+        // Threads formatting at once do not corrupt each other's output.
+        std::vector<int>         errors (4);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            const long long first = 1500000000000LL + t * 3599999LL;
+            threads.emplace_back (run, first, 1234567LL, 20000, &errors[t]);
+        }
+        for (auto& thread : threads)
+            thread.join();
+        for (int t = 0; t < 4; ++t)
+            EXPECT_EQ (errors[t], 0) << tz;
+    }
+    if (saved) setenv ("TZ", saved_tz.c_str(), 1);
+    else unsetenv ("TZ");
+    tzset();
+}
+
+TEST (DateTime, Clocks) {
+    namespace dt = gpw::util::dt;
+
+    std::int64_t previous = dt::now_nsec();
+    for (int i = 0; i < 1000; ++i) {
+        const std::int64_t t = dt::now_nsec();
+        EXPECT_GE (t, previous);
+        previous = t;
+    }
+
+    // Sub-millisecond durations are not truncated.
+    const double msec = dt::measure_time_msec ([] {
+        std::this_thread::sleep_for (std::chrono::microseconds{300});
+    });
+    EXPECT_GT (msec, 0.29);
+    EXPECT_LT (msec, 1000.0);
+
+    EXPECT_GT (dt::tsc_clock::nsec_per_tick(), 0.0);
+    if (!dt::tsc_clock::is_tsc()) {
+        EXPECT_EQ (dt::tsc_clock::nsec_per_tick(), 1.0);
+    }
+    const std::uint64_t start = dt::tsc_clock::ticks();
+    std::this_thread::sleep_for (std::chrono::milliseconds{20});
+    const double elapsed = dt::tsc_clock::to_nsec (dt::tsc_clock::ticks() - start);
+    EXPECT_GT (elapsed, 19e6);
+    EXPECT_LT (elapsed, 1e9);
+
+    dt::time_counter         counter;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back ([&counter] {
+            for (int i = 0; i < 1000; ++i)
+                dt::scoped_timer timer{counter};
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_EQ (counter.count(), 4000u);
+    EXPECT_LT (counter.mean_nsec(), 1e6);
+    {
+        dt::scoped_timer timer{counter};
+        std::this_thread::sleep_for (std::chrono::milliseconds{5});
+    }
+    EXPECT_EQ (counter.count(), 4001u);
+    EXPECT_GT (counter.total_nsec(), 4.9e6);
+    counter.reset();
+    EXPECT_EQ (counter.count(), 0u);
+    EXPECT_EQ (counter.mean_nsec(), 0.0);
+}
+
+TEST (DateTime, Benchmark) {
+    namespace dt = gpw::util::dt;
+
+    std::vector<double> samples;
+    for (int i = 100; i >= 1; --i)
+        samples.push_back (i);
+    const auto stats = dt::summarize ("linear", 7, samples);
+    EXPECT_EQ (stats.samples, samples);
+    EXPECT_EQ (stats.iterations, 7u);
+    EXPECT_DOUBLE_EQ (stats.min, 1);
+    EXPECT_DOUBLE_EQ (stats.max, 100);
+    EXPECT_DOUBLE_EQ (stats.mean, 50.5);
+    EXPECT_DOUBLE_EQ (stats.median, 50.5);
+    EXPECT_DOUBLE_EQ (stats.p90, 90.1);
+    EXPECT_DOUBLE_EQ (stats.p99, 99.01);
+    EXPECT_DOUBLE_EQ (stats.mad, 25);
+
+    dt::benchmark_options options;
+    options.warmup_msec   = 2;
+    options.sample_msec   = 1;
+    options.count_samples = 5;
+    dt::benchmark_runner bench{options};
+
+    std::vector<int> values (1000, 1);
+    const auto&      sum = bench.run ("sum", [&values] {
+        int total = 0;
+        for (const int v : values)
+            total += v;
+        dt::do_not_optimize (total);
+    });
+    EXPECT_EQ (sum.samples.size(), 5u);
+    EXPECT_GT (sum.iterations, 1u);
+    EXPECT_LE (sum.min, sum.median);
+    EXPECT_LE (sum.median, sum.p90);
+    EXPECT_LE (sum.p90, sum.p99);
+    EXPECT_LE (sum.p99, sum.max);
+    EXPECT_GT (sum.min, 0.0);
+
+    bench.run ("fill, \"zeros\"", [&values] {
+        std::fill (values.begin(), values.end(), 0);
+        dt::clobber_memory();
+    });
+    ASSERT_EQ (bench.results().size(), 2u);
+
+    const std::string json = bench.to_json();
+    EXPECT_EQ (json.rfind ("{\"benchmarks\": [\n  {\"name\": \"sum\", \"iterations\": ", 0), 0u);
+    EXPECT_NE (json.find ("\"name\": \"fill, \\\"zeros\\\"\", \"iterations\""), std::string::npos);
+    EXPECT_NE (json.find ("\"mad_ns\": "), std::string::npos);
+
+    const std::string csv = bench.to_csv();
+    const std::string header =
+        "name,iterations,samples,min_ns,mean_ns,median_ns,p90_ns,p99_ns,max_ns,mad_ns\n";
+    EXPECT_EQ (csv.rfind (header + "sum,", 0), 0u);
+    EXPECT_NE (csv.find ("\n\"fill, \"\"zeros\"\"\","), std::string::npos);
+    EXPECT_EQ (std::count (csv.begin(), csv.end(), '\n'), 3);
+}
+
+TEST (DateTime, ProfileZones) {
+    namespace profile = gpw::profile;
+    profile::collect();
+
+    {
+        GPW_PROFILE_ZONE ("disabled");
+    }
+    EXPECT_TRUE (profile::collect().events.empty());
+
+    profile::enable();
+    profile::set_thread_name ("main \"test\"");
+    {
+        GPW_PROFILE_ZONE ("request");
+        for (int i = 0; i < 2; ++i) {
+            GPW_PROFILE_ZONE ("parse");
+            std::this_thread::sleep_for (std::chrono::microseconds{100});
+        }
+    }
+    auto trace = profile::collect();
+    ASSERT_EQ (trace.events.size(), 3u);
+    const auto& request = trace.events[0];
+    EXPECT_STREQ (request.name, "request");
+    EXPECT_EQ (request.depth, 0u);
+    for (int i = 1; i < 3; ++i) {
+        EXPECT_STREQ (trace.events[i].name, "parse");
+        EXPECT_EQ (trace.events[i].depth, 1u);
+        EXPECT_EQ (trace.events[i].thread, request.thread);
+        EXPECT_GE (trace.events[i].begin, request.begin);
+        EXPECT_LE (trace.events[i].end, request.end);
+        const auto ticks = trace.events[i].end - trace.events[i].begin;
+        EXPECT_GT (gpw::util::dt::tsc_clock::to_nsec (ticks), 9e4);
+    }
+    EXPECT_EQ (trace.dropped, 0u);
+
+    const std::string json = trace.to_json();
+    EXPECT_EQ (json.rfind ("{\"traceEvents\": [\n{\"name\": \"request\", \"ph\": \"X\"", 0), 0u);
+    EXPECT_NE (json.find ("\"args\": {\"name\": \"main \\\"test\\\"\"}}"), std::string::npos);
+    EXPECT_TRUE (profile::collect().events.empty());
+
+    // One in three outermost zones, with their nested zones
+    profile::set_sampling (3);
+    for (int i = 0; i < 9; ++i) {
+        GPW_PROFILE_ZONE ("sampled");
+        GPW_PROFILE_ZONE ("nested");
+    }
+    EXPECT_EQ (profile::collect().events.size(), 6u);
+    profile::set_sampling (1);
+
+    // A full buffer overwrites its oldest events.
+    profile::set_buffer_capacity (8);
+    std::thread{[] {
+        for (int i = 0; i < 20; ++i) {
+            GPW_PROFILE_ZONE ("overflow");
+        }
+    }}.join();
+    trace = profile::collect();
+    EXPECT_EQ (trace.events.size(), 8u);
+    EXPECT_EQ (trace.dropped, 12u);
+    profile::set_buffer_capacity (1 << 16);
+
+    gpw::concurrency::thread_pool pool;
+    gpw::concurrency::latch       done (5);
+    pool.start();
+    for (int i = 0; i < 5; ++i) {
+        pool.queue_job ([&done] {
+            {
+                GPW_PROFILE_ZONE ("job body");
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    pool.stop();  // The workers close their "thread_pool job" zones.
+    trace = profile::collect();
+    std::size_t count_jobs = 0, count_bodies = 0;
+    for (const auto& e : trace.events) {
+        count_jobs += std::string_view{e.name} == "thread_pool job";
+        count_bodies += std::string_view{e.name} == "job body" && e.depth == 1;
+    }
+    EXPECT_EQ (count_jobs, 5u);
+    EXPECT_EQ (count_bodies, 5u);
+    EXPECT_TRUE (std::any_of (trace.threads.begin(), trace.threads.end(), [] (const auto& thread) {
+        return thread.second == "thread_pool worker";
+    }));
+    profile::enable (false);
+
+    // Threads which record no zone are not registered.
+    profile::collect();
+    const std::size_t count_threads = profile::collect().threads.size();
+    gpw::concurrency::thread_pool idle;
+    idle.start();
+    idle.stop();
+    EXPECT_EQ (profile::collect().threads.size(), count_threads);
+}
+
+TEST (DateTime, ProgressMeter) {
+    namespace dt = gpw::util::dt;
+    constexpr std::int64_t sec = 1000000000;
+
+    dt::progress_meter meter{1000, 1.0, 2.0};
+    meter.restart (0);
+    auto snapshot = meter.update (0);
+    EXPECT_EQ (snapshot.done, 0u);
+    EXPECT_TRUE (std::isinf (snapshot.eta_sec));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back ([&meter] {
+            for (int i = 0; i < 25; ++i)
+                meter.add();
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    snapshot = meter.update (sec);
+    EXPECT_EQ (snapshot.done, 100u);
+    EXPECT_DOUBLE_EQ (snapshot.average_rate, 100);
+    EXPECT_DOUBLE_EQ (snapshot.ewma_rate, 100);
+    EXPECT_DOUBLE_EQ (snapshot.window_rate, 100);
+    EXPECT_DOUBLE_EQ (snapshot.eta_sec, 9);
+
+    // The throughput triples: the EWMA moves halfway in one half life, and
+    // the window of 2 s still covers the first second.
+    meter.add (300);
+    snapshot = meter.update (2 * sec);
+    EXPECT_DOUBLE_EQ (snapshot.average_rate, 200);
+    EXPECT_DOUBLE_EQ (snapshot.ewma_rate, 200);
+    EXPECT_DOUBLE_EQ (snapshot.window_rate, 200);
+    EXPECT_DOUBLE_EQ (snapshot.eta_sec, 3);
+
+    meter.add (300);
+    snapshot = meter.update (3 * sec);
+    EXPECT_DOUBLE_EQ (snapshot.ewma_rate, 250);
+    EXPECT_DOUBLE_EQ (snapshot.window_rate, 300);
+    EXPECT_EQ (snapshot.to_string(), "700/1000 (70.0%) 250.0/s ETA 00:00:01.200");
+
+    meter.add (300);
+    EXPECT_EQ (meter.update (4 * sec).eta_sec, 0.0);
+
+    meter.restart (0);
+    meter.set_total (0);
+    meter.add (5);
+    snapshot = meter.update (sec);
+    EXPECT_EQ (snapshot.done, 5u);
+    EXPECT_TRUE (std::isinf (snapshot.eta_sec));
+    EXPECT_EQ (snapshot.to_string(), "5 5.0/s ETA --");
+}
+
+TEST (DateTime, ParseTimeStamp) {
+    namespace dt = gpw::util::dt;
+
+    // 2024-03-09T14:05:09Z
+    constexpr long long secs = 1709993109;
+    EXPECT_EQ (dt::parse_time_stamp ("2024-03-09T14-05-09.250-UTC").value, secs * 1000 + 250);
+    EXPECT_EQ (dt::parse_time_stamp ("2024-03-09T14-05-09-UTC").value, secs * 1000);
+    constexpr long long nsecs = secs * 1000000000;
+    EXPECT_EQ (dt::parse_time_stamp_nsec ("2024-03-09T14:05:09.250123Z").value, nsecs + 250123000);
+    const auto truncated = dt::parse_time_stamp_nsec ("2024-03-09t14:05:09.1234567891z");
+    EXPECT_EQ (truncated.value, nsecs + 123456789);
+    EXPECT_EQ (dt::parse_time_stamp ("2024-03-09 14:05:09,25+09:00").value, secs * 1000 - 32399750);
+    EXPECT_EQ (dt::parse_time_stamp ("2024-03-09T14:05:09+0900").value, (secs - 32400) * 1000);
+    EXPECT_EQ (dt::parse_time_stamp ("2024-03-09T14:05:09+09").value, (secs - 32400) * 1000);
+    EXPECT_EQ (dt::parse_time_stamp ("2024-03-09T14:05:09-01:30").value, (secs + 5400) * 1000);
+    EXPECT_EQ (dt::parse_time_stamp ("1969-12-31T23:59:59.999Z").value, -1);
+    EXPECT_EQ (dt::parse_time_stamp ("2024-02-29T00:00:00Z").value, 1709164800000);
+    EXPECT_TRUE (dt::parse_time_stamp ("2300-01-01T00:00:00Z"));
+
+    using std::errc;
+    EXPECT_EQ (dt::parse_time_stamp_nsec ("2300-01-01T00:00:00Z").error, errc::result_out_of_range);
+    for (const char* str :
+         {"", "2024-03-0", "2024-03-09T", "2024-03-09Z", "2023-02-29", "2024-02-30T00:00:00Z",
+          "2024-13-01", "2024-00-01", "2024-03-00", "x024-03-09", "2024/03/09",
+          "2024-03-09T24:00:00Z", "2024-03-09T14:60:00Z", "2024-03-09T14:05Z",
+          "2024-03-09T14:05-09Z", "2024-03-09T14:05:09.Z",
+          "2024-03-09T14:05:09+9", "2024-03-09T14:05:09+09:0", "2024-03-09T14:05:09+24:00",
+          "2024-03-09T14:05:09+09/5", "2024-03-09T14:05:09+0a00", "2024-03-09T14:05:09+09:5x",
+          "2024-03-09T14:05:09+09-00", "2024-03-09T14:05:09Zx", "2024-03-09T14:05:09-UTCx",
+          "2024-03-09X14:05:09Z",
+          "2024-03-09T1\xff:05:09Z"}) {
+        EXPECT_EQ (dt::parse_time_stamp (str).error, errc::invalid_argument) << str;
+        EXPECT_EQ (dt::parse_time_stamp (str).value, 0) << str;
+    }
+
+    // Local times parse back to the time they were formatted from, in time
+    // zones with DST (a new thread starts with an empty offset cache).
+    const char* const saved = std::getenv ("TZ");
+    const std::string saved_tz{saved ? saved : ""};
+    for (const char* tz : {"UTC0", "EST5EDT,M3.2.0,M11.1.0", "NST3:30NDT,M3.2.0,M11.1.0"}) {
+        setenv ("TZ", tz, 1);
+        tzset();
+        int count_errors = 0;
+        std::thread{[&count_errors] {
+            for (long long msecs = -86400000LL * 400; msecs < 1800000000000LL; msecs += 999999937) {
+                for (const bool utc : {false, true}) {
+                    const std::string str    = dt::time_stamp (msecs, true, utc);
+                    const auto        parsed = dt::parse_time_stamp (str);
+                    count_errors += !parsed || dt::time_stamp (parsed.value, true, utc) != str;
+                    count_errors += utc && parsed.value != msecs;
+                }
+            }
+            const auto midnight = dt::parse_time_stamp ("2024-03-09");
+            count_errors += midnight.value != dt::parse_time_stamp ("2024-03-09T00:00:00").value;
+            count_errors += dt::time_stamp (midnight.value, false, false) != "2024-03-09T00-00-00";
+        }}.join();
+        EXPECT_EQ (count_errors, 0) << tz;
+    }
+    if (saved) setenv ("TZ", saved_tz.c_str(), 1);
+    else unsetenv ("TZ");
+    tzset();
+
+    const std::vector<std::string_view> fields = {
+        "2024-03-09T14:05:09Z", "2024-03-09T14:05:10.5Z", "2024-03-09T14:05:1xZ",
+        "2024-03-10T00:00:00Z", "2300-01-01T00:00:00Z"};
+    std::vector<long long> out;
+    EXPECT_EQ (dt::parse_time_stamp (fields, out), 2u);
+    EXPECT_EQ (out, (std::vector<long long>{secs * 1000, secs * 1000 + 1500, 0, 1710028800000,
+                                            10413792000000}));
+    EXPECT_EQ (dt::parse_time_stamp_nsec (fields, out), 2u);
+    EXPECT_EQ (out[1], nsecs + 1500000000);
+    EXPECT_EQ (out[4], 0);
+}
+
+TEST (Filesystem, MappedFile) {
+    using gpw::filesystem::mapped_file;
+
+    std::string contents;
+    for (int i = 0; i < 100000; ++i)
+        contents += "line " + std::to_string (i) + "\r\n";
+    contents += std::string (3, '\0');
+
+    const auto path = fs::temp_directory_path() / "gpw_mapped_file_test.bin";
+    std::ofstream (path, std::ios::binary) << contents;
+
+    mapped_file file{path, mapped_file::sequential | mapped_file::will_need};
+    EXPECT_TRUE (file.is_mapped());
+    EXPECT_EQ (file.size(), contents.size());
+    EXPECT_TRUE (file.view() == contents);
+    EXPECT_EQ (static_cast<const void*> (file.bytes()), file.view().data());
+    EXPECT_TRUE (file.advise (mapped_file::dont_need, 5000, 100000));
+    EXPECT_TRUE (file.view() == contents);
+    EXPECT_TRUE (file.advise (mapped_file::random, file.size() + 1));
+
+    // Small files are read into a buffer.
+    const mapped_file small{path, mapped_file::normal, contents.size() + 1};
+    EXPECT_FALSE (small.is_mapped());
+    EXPECT_TRUE (small.view() == contents);
+    EXPECT_EQ (gpw::filesystem::to_string (path), contents);
+
+    mapped_file moved{std::move (file)};
+    EXPECT_TRUE (file.empty());
+    EXPECT_TRUE (moved.view() == contents);
+    file = std::move (moved);
+    EXPECT_TRUE (file.view() == contents);
+    file.close();
+    EXPECT_TRUE (file.empty());
+
+    std::ofstream (path, std::ios::binary | std::ios::trunc);
+    const mapped_file empty{path, mapped_file::sequential, 0};
+    EXPECT_TRUE (empty.empty());
+    EXPECT_FALSE (empty.is_mapped());
+    fs::remove (path);
+
+    EXPECT_THROW (mapped_file{path}, std::runtime_error);
+    EXPECT_EQ (gpw::filesystem::to_string (path), "");
+
+#if defined(__linux__)
+    // Files of /proc report a size of 0 but have contents.
+    const mapped_file status{"/proc/self/status", mapped_file::normal, 0};
+    EXPECT_FALSE (status.is_mapped());
+    EXPECT_NE (status.view().find ("Name:"), std::string_view::npos);
+#endif
+}
+
+TEST (Filesystem, LineReader) {
+    using gpw::filesystem::line_reader;
+
+    // Records shorter and longer than the blocks, empty ones, CRLF endings
+    std::string              contents;
+    std::vector<std::string> expected;
+    std::uint32_t            seed = 5;
+    for (int i = 0; i < 2000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        const std::size_t length = ((seed >> 16) % 7 == 0) ? (seed >> 8) % 300 : (seed >> 16) % 20;
+        const std::string line (length, 'a' + i % 26);
+        contents += line + ((i % 3 == 0) ? "\r\n" : "\n");
+        expected.push_back (line);
+    }
+    contents += "last";
+    expected.push_back ("last");
+
+    const auto path  = fs::temp_directory_path() / "gpw_line_reader_test.txt";
+    auto       write = [&path] (const std::string& str) {
+        std::ofstream (path, std::ios::binary | std::ios::trunc) << str;
+    };
+    auto read_all = [&path] (char delimiter, std::size_t block_size, bool read_ahead) {
+        line_reader              reader{path, delimiter, block_size, read_ahead};
+        std::vector<std::string> records;
+        std::string_view         record;
+        while (reader.next (record))
+            records.emplace_back (record);
+        EXPECT_FALSE (reader.next (record));
+        EXPECT_EQ (reader.count(), records.size());
+        return records;
+    };
+
+    write (contents);
+    for (const bool read_ahead : {false, true}) {
+        for (const std::size_t block_size : {1, 7, 64, 4096, 1 << 20})
+            EXPECT_EQ (read_all ('\n', block_size, read_ahead), expected) << block_size;
+    }
+
+    write ("a;b;;c;");
+    EXPECT_EQ (read_all (';', 2, true), (std::vector<std::string>{"a", "b", "", "c"}));
+    write ("x\r\n\n");
+    EXPECT_EQ (read_all ('\n', 1, true), (std::vector<std::string>{"x", ""}));
+    write ("");
+    EXPECT_TRUE (read_all ('\n', 16, true).empty());
+    EXPECT_TRUE (read_all ('\n', 16, false).empty());
+
+    // Destroyed before the end, with the read ahead thread waiting
+    write (contents);
+    {
+        line_reader      reader{path, '\n', 16};
+        std::string_view record;
+        EXPECT_TRUE (reader.next (record));
+        EXPECT_EQ (record, expected[0]);
+    }
+
+    fs::remove (path);
+    EXPECT_THROW (line_reader{path}, std::runtime_error);
+}
+
+TEST (Filesystem, CopyAndMove) {
+    namespace gf = gpw::filesystem;
+    using gf::copy_method;
+
+    const auto base = fs::temp_directory_path() / "gpw_copy_test";
+    fs::remove_all (base);
+    fs::create_directories (base / "src" / "sub");
+    fs::create_directory (base / "out");
+
+    std::string   contents;
+    std::uint32_t seed = 7;
+    for (int i = 0; i < (3 << 20); ++i) {
+        seed = seed * 1103515245 + 12345;
+        contents += static_cast<char> (seed >> 24);
+    }
+    std::ofstream (base / "src" / "data.bin", std::ios::binary) << contents;
+    std::ofstream (base / "src" / "sub" / "empty.txt");
+    fs::permissions (base / "src" / "data.bin", fs::perms::owner_read | fs::perms::group_read);
+    fs::create_directory_symlink ("..", base / "src" / "sub" / "up");  // A loop
+    fs::create_symlink ("nowhere", base / "src" / "sub" / "dangling");
+
+    // Copied by one of the mechanisms, with the permissions
+    const auto src = base / "src" / "data.bin";
+    EXPECT_GE (gf::copy_regular_file (src, base / "copy.bin"), copy_method::reflink);
+    EXPECT_EQ (gf::to_string (base / "copy.bin"), contents);
+    EXPECT_EQ (fs::status (base / "copy.bin").permissions(), fs::status (src).permissions());
+    EXPECT_THROW (gf::copy_regular_file (src, base / "copy.bin"), std::runtime_error);
+    EXPECT_THROW (gf::copy_regular_file (base / "missing", base / "copy2.bin"), std::runtime_error);
+    EXPECT_FALSE (fs::exists (base / "copy2.bin"));
+    EXPECT_EQ (gf::to_string (copy_method::copy_file_range), "copy_file_range");
+    EXPECT_EQ (
+        gf::copy_regular_file (base / "src" / "sub" / "empty.txt", base / "empty.txt"),
+        copy_method::none
+    );
+
+    // Whole trees, with the links copied as links
+    EXPECT_GE (gf::copy_item_to (base / "src", base / "out"), copy_method::reflink);
+    EXPECT_EQ (gf::to_string (base / "out" / "src" / "data.bin"), contents);
+    EXPECT_TRUE (fs::exists (base / "out" / "src" / "sub" / "empty.txt"));
+    EXPECT_EQ (fs::read_symlink (base / "out" / "src" / "sub" / "up"), "..");
+    EXPECT_EQ (fs::read_symlink (base / "out" / "src" / "sub" / "dangling"), "nowhere");
+    EXPECT_THROW (gf::copy_item_to (base / "src", base / "out"), std::runtime_error);
+
+    // A failed copy leaves nothing behind.
+    fs::create_directories (base / "special" / "a");
+    std::ofstream (base / "special" / "a" / "file") << "x";
+    ASSERT_EQ (::mkfifo ((base / "special" / "fifo").c_str(), 0600), 0);
+    EXPECT_THROW (gf::copy_item_to (base / "special", base / "out"), std::runtime_error);
+    EXPECT_FALSE (fs::exists (base / "out" / "special"));
+    fs::remove_all (base / "special");
+
+    // An existing destination is left unchanged.
+    fs::create_directories (base / "dst");
+    fs::create_directories (base / "newer");
+    std::ofstream (base / "dst" / "a.txt") << "OLD precious";
+    std::ofstream (base / "a.txt") << "new";
+    std::ofstream (base / "newer" / "a.txt") << "newer";
+    EXPECT_THROW (gf::move_item_to (base / "a.txt", base / "dst"), std::runtime_error);
+    EXPECT_THROW (
+        gf::move_directory_contents_to (base / "newer", base / "dst"), std::runtime_error
+    );
+    EXPECT_EQ (gf::to_string (base / "dst" / "a.txt"), "OLD precious");
+    EXPECT_EQ (gf::to_string (base / "a.txt"), "new");
+    EXPECT_EQ (gf::to_string (base / "newer" / "a.txt"), "newer");
+
+    // Links at the top level keep their own names, dangling or not.
+    fs::create_directory (base / "links");
+    fs::create_directory (base / "moved_links");
+    fs::create_symlink ("a.txt", base / "mylink");
+    fs::create_symlink ("nowhere", base / "broken");
+    for (const char* name : {"mylink", "broken"}) {
+        EXPECT_EQ (gf::copy_item_to (base / name, base / "links"), copy_method::none) << name;
+        EXPECT_TRUE (fs::is_symlink (base / "links" / name)) << name;
+        EXPECT_EQ (gf::move_item_to (base / name, base / "moved_links"), copy_method::rename);
+        EXPECT_TRUE (fs::is_symlink (base / "moved_links" / name)) << name;
+        EXPECT_FALSE (fs::exists (fs::symlink_status (base / name))) << name;
+    }
+    EXPECT_EQ (fs::read_symlink (base / "links" / "mylink"), "a.txt");
+    EXPECT_EQ (fs::read_symlink (base / "moved_links" / "broken"), "nowhere");
+    EXPECT_FALSE (fs::exists (base / "links" / "a.txt"));
+
+    // A directory given with a trailing separator
+    gf::copy_item_to (base / "newer" / "", base / "links");
+    EXPECT_EQ (gf::to_string (base / "links" / "newer" / "a.txt"), "newer");
+
+    // Renamed on the same filesystem
+    fs::create_directory (base / "moved");
+    EXPECT_EQ (gf::move_item_to (base / "out" / "src", base / "moved"), copy_method::rename);
+    EXPECT_FALSE (fs::exists (base / "out" / "src"));
+    EXPECT_EQ (gf::to_string (base / "moved" / "src" / "data.bin"), contents);
+    EXPECT_EQ (
+        gf::move_directory_contents_to (base / "moved" / "src", base / "out"), copy_method::rename
+    );
+    EXPECT_TRUE (fs::exists (base / "out" / "sub" / "empty.txt"));
+    EXPECT_TRUE (fs::is_empty (base / "moved" / "src"));
+
+    fs::permissions (src, fs::perms::owner_all);
+    fs::remove_all (base);
+}
+
+TEST (Filesystem, ParallelTree) {
+    namespace gf = gpw::filesystem;
+    using gf::copy_method;
+
+    const auto base = fs::temp_directory_path() / "gpw_parallel_fs_test";
+    fs::remove_all (base);
+    for (const char* dir : {"src/a/b", "src/c", "out", "moved"})
+        fs::create_directories (base / dir);
+
+    // 3 levels of files of various sizes
+    std::size_t   count_files = 0;
+    std::uint64_t bytes       = 0;  // Outside src/c
+    std::uint32_t seed        = 3;
+    for (const char* dir : {"src", "src/a", "src/a/b", "src/c"}) {
+        for (int i = 0; i < 50; ++i) {
+            seed = seed * 1103515245 + 12345;
+            const std::string contents ((seed >> 16) % 5000, static_cast<char> ('a' + i % 26));
+            std::ofstream (base / dir / ("f" + std::to_string (i))) << contents;
+            ++count_files;
+            if (std::string_view{dir} != "src/c") bytes += contents.size();
+        }
+    }
+    fs::create_symlink ("f0", base / "src" / "link");
+    fs::create_directory (base / "out" / "c");  // Conflicts with src/c
+
+    gpw::concurrency::thread_pool pool;
+    pool.start();
+
+    auto result = gf::copy_directory_contents_parallel (base / "src", base / "out", pool, 4);
+    ASSERT_EQ (result.errors.size(), 1);
+    EXPECT_EQ (result.errors[0].path, base / "src" / "c");
+    EXPECT_EQ (result.count_files, count_files - 50 + 1);
+    EXPECT_EQ (result.count_directories, 2);
+    EXPECT_EQ (result.bytes, bytes);
+    EXPECT_GE (result.method, copy_method::reflink);
+    EXPECT_EQ (
+        gf::to_string (base / "out" / "a" / "b" / "f7"),
+        gf::to_string (base / "src" / "a" / "b" / "f7")
+    );
+    EXPECT_TRUE (fs::is_symlink (base / "out" / "link"));
+    EXPECT_TRUE (fs::is_empty (base / "out" / "c"));
+
+    // Renamed on the same filesystem
+    result = gf::move_directory_contents_parallel (base / "src", base / "moved", pool);
+    EXPECT_TRUE (result.ok());
+    EXPECT_EQ (result.method, copy_method::rename);
+    EXPECT_EQ (result.count_files, 50 + 1);
+    EXPECT_EQ (result.count_directories, 2);
+    EXPECT_TRUE (fs::is_empty (base / "src"));
+    EXPECT_TRUE (fs::exists (base / "moved" / "a" / "b" / "f49"));
+
+    // Copied and removed, as between filesystems
+    fs::create_directory (base / "copied");
+    std::uint64_t moved_bytes = 0;
+    for (const auto& entry : fs::recursive_directory_iterator{base / "moved"})
+        if (entry.is_regular_file() && !entry.is_symlink()) moved_bytes += entry.file_size();
+    result = gf::detail::move_directory_contents_by_copy (base / "moved", base / "copied", pool, 4);
+    EXPECT_TRUE (result.ok());
+    EXPECT_EQ (result.count_files, count_files + 1);
+    EXPECT_EQ (result.count_directories, 3);
+    EXPECT_EQ (result.bytes, moved_bytes);
+    EXPECT_GE (result.method, copy_method::reflink);
+    EXPECT_TRUE (fs::is_empty (base / "moved"));
+    EXPECT_TRUE (fs::is_symlink (base / "copied" / "link"));
+    EXPECT_EQ (
+        gf::to_string (base / "copied" / "a" / "b" / "f7"),
+        gf::to_string (base / "out" / "a" / "b" / "f7")
+    );
+    fs::remove (base / "moved");
+    fs::rename (base / "copied", base / "moved");
+
+    result = gf::remove_all_contents_parallel (base / "moved", pool, false, 1);
+    EXPECT_TRUE (result.ok());
+    EXPECT_EQ (result.count_files, count_files + 1);
+    EXPECT_EQ (result.count_directories, 3);
+    EXPECT_TRUE (fs::is_empty (base / "moved"));
+
+    result = gf::remove_all_contents_parallel (base, pool, true, SIZE_MAX);
+    EXPECT_TRUE (result.ok());
+    EXPECT_FALSE (fs::exists (base));
+    EXPECT_THROW (gf::remove_all_contents_parallel (base, pool), std::runtime_error);
+
+    pool.stop();
+}